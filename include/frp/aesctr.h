@@ -11,7 +11,9 @@
 #include <limits>
 #include <cstdint>
 #include <cstring>
+#include <algorithm>
 #include <array>
+#include <utility>
 #include <type_traits>
 #include <immintrin.h>
 
@@ -23,6 +25,88 @@ using std::uint8_t;
 using std::size_t;
 
 
+namespace detail {
+
+static constexpr size_t AES128_ROUNDS = 10;
+
+// Encrypts counters (stream, ctr), (stream, ctr + 1), ... under the expanded key `keys`
+// and stores nblocks 16-byte blocks to dst, which need not be aligned.
+inline void encrypt_blocks_aesni(const __m128i *keys, uint64_t stream, uint64_t ctr, size_t nblocks, uint8_t *dst) {
+    static constexpr size_t LANES = 8; // Enough independent blocks to cover aesenc latency.
+    size_t i(0);
+    for(; i + LANES <= nblocks; i += LANES) {
+        __m128i b[LANES];
+        for(size_t j = 0; j < LANES; ++j) b[j] = _mm_xor_si128(_mm_set_epi64x(stream, ctr + i + j), keys[0]);
+        for(size_t r = 1; r < AES128_ROUNDS; ++r)
+            for(size_t j = 0; j < LANES; ++j) b[j] = _mm_aesenc_si128(b[j], keys[r]);
+        for(size_t j = 0; j < LANES; ++j)
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + 16 * (i + j)), _mm_aesenclast_si128(b[j], keys[AES128_ROUNDS]));
+    }
+    for(; i < nblocks; ++i) {
+        __m128i b(_mm_xor_si128(_mm_set_epi64x(stream, ctr + i), keys[0]));
+        for(size_t r = 1; r < AES128_ROUNDS; b = _mm_aesenc_si128(b, keys[r++]));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + 16 * i), _mm_aesenclast_si128(b, keys[AES128_ROUNDS]));
+    }
+}
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define AESCTR_VAES_DISPATCH 1
+// The same with 512-bit VAES, which encrypts four blocks per instruction.
+__attribute__((target("avx512f,vaes")))
+inline void encrypt_blocks_vaes(const __m128i *keys, uint64_t stream, uint64_t ctr, size_t nblocks, uint8_t *dst) {
+    static constexpr size_t LANES = 4; // zmm registers in flight, each holding four blocks.
+    __m512i k[AES128_ROUNDS + 1];
+    for(size_t r = 0; r <= AES128_ROUNDS; ++r) {
+        alignas(64) const __m128i rep[4]{keys[r], keys[r], keys[r], keys[r]};
+        k[r] = _mm512_load_si512(rep);
+    }
+    const int64_t s(stream);
+    __m512i c(_mm512_set_epi64(s, ctr + 3, s, ctr + 2, s, ctr + 1, s, ctr));
+    const __m512i step(_mm512_set_epi64(0, 4, 0, 4, 0, 4, 0, 4));
+    size_t i(0);
+    for(; i + 4 * LANES <= nblocks; i += 4 * LANES) {
+        __m512i b[LANES];
+        for(size_t j = 0; j < LANES; ++j) b[j] = _mm512_xor_si512(c, k[0]), c = _mm512_add_epi64(c, step);
+        for(size_t r = 1; r < AES128_ROUNDS; ++r)
+            for(size_t j = 0; j < LANES; ++j) b[j] = _mm512_aesenc_epi128(b[j], k[r]);
+        for(size_t j = 0; j < LANES; ++j)
+            _mm512_storeu_si512(dst + 16 * (i + 4 * j), _mm512_aesenclast_epi128(b[j], k[AES128_ROUNDS]));
+    }
+    for(; i + 4 <= nblocks; i += 4) {
+        __m512i b(_mm512_xor_si512(c, k[0]));
+        c = _mm512_add_epi64(c, step);
+        for(size_t r = 1; r < AES128_ROUNDS; b = _mm512_aesenc_epi128(b, k[r++]));
+        _mm512_storeu_si512(dst + 16 * i, _mm512_aesenclast_epi128(b, k[AES128_ROUNDS]));
+    }
+    encrypt_blocks_aesni(keys, stream, ctr + i, nblocks - i, dst + 16 * i);
+}
+
+inline bool has_vaes() {
+#if defined(__VAES__) && defined(__AVX512F__)
+    return true;
+#else
+    static const bool ret = [] {
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("vaes");
+    }();
+    return ret;
+#endif
+}
+#endif
+
+inline void encrypt_blocks(const __m128i *keys, uint64_t stream, uint64_t ctr, size_t nblocks, uint8_t *dst) {
+#ifdef AESCTR_VAES_DISPATCH
+    if(nblocks >= 16 && has_vaes()) {
+        encrypt_blocks_vaes(keys, stream, ctr, nblocks, dst);
+        return;
+    }
+#endif
+    encrypt_blocks_aesni(keys, stream, ctr, nblocks, dst);
+}
+
+} // namespace detail
+
+
 #define AES_ROUND(rcon, index)                                                 \
   do {                                                                         \
     __m128i k2 = _mm_aeskeygenassist_si128(k, rcon);                           \
@@ -36,12 +120,14 @@ using std::size_t;
 
 template<typename GeneratedType=uint64_t, size_t UNROLL_COUNT=4, typename=std::enable_if_t<std::is_integral<GeneratedType>::value>>
 class AesCtr {
-    static const size_t AESCTR_ROUNDS = 10;
+    static const size_t AESCTR_ROUNDS = detail::AES128_ROUNDS;
+    static constexpr size_t BUFFER_BYTES = sizeof(__m128i) * UNROLL_COUNT;
     uint8_t state_[sizeof(__m128i) * UNROLL_COUNT];
     __m128i ctr_[UNROLL_COUNT];
     __m128i seed_[AESCTR_ROUNDS + 1];
     __m128i work[UNROLL_COUNT];
     size_t offset_;
+    uint64_t stream_; // Upper 64 bits of the counter. Distinct streams never overlap.
 
     // Unrollers
     template<size_t ind, size_t todo>
@@ -79,23 +165,52 @@ class AesCtr {
         void add_store([[maybe_unused]] __m128i *work, [[maybe_unused]] AesCtr &state) const {}
     };
 
+    // Encrypts the next UNROLL_COUNT counters into state_.
+    void refill() {
+        aes_unroll_impl<0, UNROLL_COUNT>()(work, *this);
+        aes_unroll_impl<1, AESCTR_ROUNDS - 1>().template round_and_enc<UNROLL_COUNT>(work, *this);
+        aes_unroll_impl<0, UNROLL_COUNT>().add_store(work, *this);
+        offset_ = 0;
+    }
+    static constexpr size_t roundup_result(size_t nbytes) {
+        return (nbytes + sizeof(result_type) - 1) / sizeof(result_type) * sizeof(result_type);
+    }
+
 public:
     using result_type = GeneratedType;
-    AesCtr(uint64_t seedval=0) {
+    AesCtr(uint64_t seedval=0, uint64_t stream=0): stream_(stream) {
         seed(seedval);
     }
     result_type operator()() {
-        if (__builtin_expect(offset_ >= sizeof(__m128i) * UNROLL_COUNT, 0)) {
-            aes_unroll_impl<0, UNROLL_COUNT>()(work, *this);
-            aes_unroll_impl<1, AESCTR_ROUNDS - 1>().template round_and_enc<UNROLL_COUNT>(work, *this);
-            aes_unroll_impl<0, UNROLL_COUNT>().add_store(work, *this);
-            offset_ = 0;
-        }
+        if (__builtin_expect(offset_ >= BUFFER_BYTES, 0)) refill();
         result_type ret;
         std::memcpy(&ret, state_ + offset_, sizeof(ret));
         offset_ += sizeof(result_type);
         return ret;
     }
+    // Writes the next nbytes of the stream to dst, exactly as if ceil(nbytes / sizeof(result_type))
+    // values were drawn with operator() and their bytes copied out, the last one truncated.
+    // Whole blocks are encrypted straight into dst, four per instruction on CPUs with VAES.
+    void fill(void *dst, size_t nbytes) {
+        uint8_t *out(static_cast<uint8_t *>(dst));
+        if(offset_ < BUFFER_BYTES) {
+            const size_t take(std::min(nbytes, BUFFER_BYTES - offset_));
+            std::memcpy(out, state_ + offset_, take);
+            offset_ += roundup_result(take);
+            out += take, nbytes -= take;
+            if(nbytes == 0) return;
+        }
+        // The buffer is exhausted, so ctr_[0] holds the counter of the next block.
+        const uint64_t next(_mm_cvtsi128_si64(ctr_[0]));
+        const size_t nblocks(nbytes / sizeof(__m128i)), rem(nbytes % sizeof(__m128i));
+        detail::encrypt_blocks(seed_, stream_, next, nblocks, out);
+        for (unsigned i = 0; i < UNROLL_COUNT; ++i) ctr_[i] = _mm_set_epi64x(stream_, next + nblocks + i);
+        if(rem) {
+            refill();
+            std::memcpy(out + nblocks * sizeof(__m128i), state_, rem);
+            offset_ = roundup_result(rem);
+        }
+    }
     result_type max() const {return std::numeric_limits<result_type>::max();}
     result_type min() const {return std::numeric_limits<result_type>::min();}
     void seed(uint64_t k) {
@@ -117,20 +232,81 @@ public:
       AES_ROUND(0x1b, 9);
       AES_ROUND(0x36, 10);
 
-      for (unsigned i = 0; i < UNROLL_COUNT; ++i) ctr_[i] = _mm_set_epi64x(0, i);
-      offset_ = sizeof(__m128i) * UNROLL_COUNT;
+      for (unsigned i = 0; i < UNROLL_COUNT; ++i) ctr_[i] = _mm_set_epi64x(stream_, i);
+      offset_ = BUFFER_BYTES;
+    }
+    // Switches to the start of substream `stream` under the same key.
+    // Stream 0 is the default sequence, so AesCtr(seed) and AesCtr(seed, 0) agree.
+    void set_stream(uint64_t stream) {
+      stream_ = stream;
+      for (unsigned i = 0; i < UNROLL_COUNT; ++i) ctr_[i] = _mm_set_epi64x(stream_, i);
+      offset_ = BUFFER_BYTES;
     }
+    uint64_t stream() const {return stream_;}
     result_type operator[](size_t count) const {
         static constexpr unsigned DIV   = sizeof(__m128i) / sizeof(result_type);
         static constexpr unsigned BMASK = DIV - 1;
         const unsigned offset_(count & BMASK);
-        result_type ret[DIV];
+        alignas(16) result_type ret[DIV];
         count /= DIV;
-        __m128i tmp(_mm_xor_si128(_mm_set_epi64x(0, count), seed_[0]));
+        __m128i tmp(_mm_xor_si128(_mm_set_epi64x(stream_, count), seed_[0]));
         for (unsigned r = 1; r <= AESCTR_ROUNDS - 1; tmp = _mm_aesenc_si128(tmp, seed_[r++]));
         _mm_store_si128((__m128i *)ret, _mm_aesenclast_si128(tmp, seed_[AESCTR_ROUNDS]));
         return ret[offset_];
     }
+    // Writes values [start, start + count) of the current stream to dst, so dst[i] == (*this)[start + i].
+    // Whole blocks go through the same bulk path as fill(). The generator's position is unchanged.
+    void generate_range(uint64_t start, size_t count, result_type *dst) const {
+        static constexpr size_t DIV = sizeof(__m128i) / sizeof(result_type);
+        alignas(16) result_type tmp[DIV];
+        uint64_t block(start / DIV);
+        if(const size_t lead = start % DIV) {
+            const size_t n(std::min(DIV - lead, count));
+            detail::encrypt_blocks(seed_, stream_, block++, 1, reinterpret_cast<uint8_t *>(tmp));
+            std::memcpy(dst, tmp + lead, n * sizeof(result_type));
+            dst += n, count -= n;
+        }
+        const size_t nblocks(count / DIV);
+        detail::encrypt_blocks(seed_, stream_, block, nblocks, reinterpret_cast<uint8_t *>(dst));
+        if(const size_t rem = count % DIV) {
+            detail::encrypt_blocks(seed_, stream_, block + nblocks, 1, reinterpret_cast<uint8_t *>(tmp));
+            std::memcpy(dst + nblocks * DIV, tmp, rem * sizeof(result_type));
+        }
+    }
+    // Index in the current stream of the value the next operator() call returns.
+    uint64_t position() const {
+        static constexpr size_t DIV = sizeof(__m128i) / sizeof(result_type);
+        // ctr_[0] is one buffer past the buffered blocks, which also holds when the buffer is exhausted.
+        const uint64_t first_block(static_cast<uint64_t>(_mm_cvtsi128_si64(ctr_[0])) - UNROLL_COUNT);
+        return first_block * DIV + offset_ / sizeof(result_type);
+    }
+    // Moves to value `pos` of the current stream, in constant time.
+    void seek(uint64_t pos) {
+        static constexpr size_t DIV = sizeof(__m128i) / sizeof(result_type);
+        const uint64_t block(pos / DIV);
+        for (unsigned i = 0; i < UNROLL_COUNT; ++i) ctr_[i] = _mm_set_epi64x(stream_, block + i);
+        offset_ = BUFFER_BYTES;
+        if(const size_t rem = pos % DIV) {
+            refill();
+            offset_ = rem * sizeof(result_type);
+        }
+    }
+    // Skips the next n values, as if operator() had been called n times.
+    void jump(uint64_t n) {seek(position() + n);}
+    // Bounds [first, last) of part k when n values are divided into nparts contiguous parts,
+    // whose sizes differ by at most one.
+    static std::pair<uint64_t, uint64_t> partition(size_t k, size_t nparts, uint64_t n) {
+        const uint64_t q(n / nparts), r(n % nparts);
+        const uint64_t first(k * q + std::min<uint64_t>(k, r));
+        return {first, first + q + (k < r)};
+    }
+    // A copy positioned at part k of the next n values (see partition()).
+    // Drawing each part from its own copy, on any number of threads, reproduces the serial sequence exactly.
+    AesCtr split(size_t k, size_t nparts, uint64_t n) const {
+        AesCtr ret(*this);
+        ret.jump(partition(k, nparts, n).first);
+        return ret;
+    }
 };
 #undef AES_ROUND
 
@@ -39,35 +39,47 @@ FWHT is done in-place.
 class PRNRademacher {
     size_t      n_;
     uint64_t seed_;
+    // Calls func(i, word) for i = 0, 64, 128, ... below n; bit j of word is the sign of element i + j.
+    // Every apply draws its signs here so vectors, pointers and batches get the same diagonal.
+    // The generator's first value is skipped, as apply always has.
+    template<typename Func>
+    void for_each_word(size_t n, const Func &func) const {
+        aes::AesCtr<uint64_t> gen(seed_); // Intentional shadow.
+        gen();
+        for(size_t i(0); i < n; i += CHAR_BIT * sizeof(uint64_t)) func(i, gen());
+    }
+    template<typename Container>
+    void apply_n(Container &c, size_t n) const {
+        using ArithType = std::decay_t<decltype(c[0])>;
+        const ArithType lut[2] = {static_cast<ArithType>(1), static_cast<ArithType>(-1)};
+        for_each_word(n, [&](size_t i, uint64_t val) {
+            for(const size_t e(std::min(n, i + CHAR_BIT * sizeof(uint64_t))); i < e; ++i, val >>= 1)
+                c[i] *= lut[val & 1];
+        });
+    }
 public:
     PRNRademacher(size_t n=0, uint64_t seed=0): n_(n), seed_(seed) {}
     auto size() const {return n_;}
     void resize(size_t newsize) {n_ = newsize;}
 
     template<typename Container>
-    void apply(Container &c) const {
-        aes::AesCtr<uint64_t> gen(seed_); // Intentional shadow.
-        uint64_t val(gen());
-        using ArithType = std::decay_t<decltype(c[0])>;
-        const ArithType lut[2] = {static_cast<ArithType>(1), static_cast<ArithType>(-1)};
-        for(size_t i(0), e(c.size()); i < e; ++i) {
-            if(unlikely((i & ((CHAR_BIT * sizeof(uint64_t)) - 1)) == 0))
-                val = gen();
-            c[i] *= lut[val & 1]; val >>= 1;
-        }
-    }
+    void apply(Container &c) const {apply_n(c, c.size());}
 
     template<typename ArithType>
-    void apply(ArithType *c, size_t nitems=0) {
-        aes::AesCtr<uint64_t> gen(seed_);
-        uint64_t val;
-        if(nitems == 0) nitems = n_;
-        const ArithType lut[2] = {static_cast<ArithType>(1), static_cast<ArithType>(-1)};
-        for(size_t i(0); i < nitems; ++i) {
-            if(unlikely((i & ((CHAR_BIT * sizeof(uint64_t)) - 1)) == 0))
-                val = gen();
-            c[i] *= lut[val & 1]; val >>= 1;
-        }
+    void apply(ArithType *c, size_t nitems=0) const {apply_n(c, nitems ? nitems: n_);}
+    // Diagonal matrices are their own transposes.
+    template<typename Container>
+    void apply_transpose(Container &c) const {apply(c);}
+    template<typename ArithType>
+    void apply_transpose(ArithType *c, size_t nitems=0) const {apply(c, nitems);}
+    // Interleaved batch (column-major, rows are vectors): negates whole columns.
+    template<typename MatrixType>
+    void apply_many(MatrixType &out) const {
+        const size_t e(out.columns());
+        for_each_word(e, [&](size_t i, uint64_t val) {
+            for(const size_t end(std::min(e, i + CHAR_BIT * sizeof(uint64_t))); i < end; ++i, val >>= 1)
+                if(val & 1) column(out, i) *= -1;
+        });
     }
 };
 
@@ -172,6 +184,16 @@ public:
             vec[i] *= tmp[i];
         }
     }
+    template<typename VectorType>
+    void apply_transpose(VectorType &vec) const {apply(vec);} // Diagonal, so symmetric.
+    // Interleaved batch (column-major, rows are vectors): each sign is read once per batch.
+    template<typename MatrixType>
+    void apply_many(MatrixType &out) const {
+        if(out.columns() > size())
+            throw std::runtime_error("Batch dimension is too big for CompactRademacherTemplate.");
+        for(size_type i = 0, e(out.columns()); i < e; ++i)
+            if(bool_idx(i)) column(out, i) *= -1;
+    }
 };
 
 using CompactRademacher = CompactRademacherTemplate<uint64_t>;
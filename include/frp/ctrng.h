@@ -0,0 +1,213 @@
+#ifndef _GFRP_CTRNG_H__
+#define _GFRP_CTRNG_H__
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+#include <utility>
+#include "frp/aesctr.h"
+
+namespace rng {
+
+/*
+ * Counter-based generators with the AesCtr interface.
+ * Value i of a stream is a pure function of (seed, stream, i), so these support
+ * operator[], bulk fill, generate_range and O(1) seek/jump/split exactly like aes::AesCtr,
+ * and can be passed wherever an RNG template argument is accepted.
+ * Philox4x32-10 (Salmon et al., 2011) is a cheaper block function than AES on cores with slow
+ * AES units and passes BigCrush; WyRand is cheaper still, for bit-hungry paths such as signs and shuffles.
+ *
+ * CounterRNG supplies buffering and the shared interface. A derived class provides
+ * generate_blocks(ctr, n, dst), writing BLOCK_BYTES bytes for each of counters ctr, ..., ctr + n - 1,
+ * and rekey(), called when the seed or stream changes.
+ */
+template<typename Derived, typename GeneratedType, size_t BLOCK_BYTES, size_t BUFFER_BLOCKS=8>
+class CounterRNG {
+    static_assert(std::is_integral<GeneratedType>::value, "Counter-based generators produce integers.");
+    static_assert(BLOCK_BYTES % sizeof(GeneratedType) == 0, "Blocks must hold a whole number of values.");
+public:
+    using result_type = GeneratedType;
+protected:
+    static constexpr size_t BUFFER_BYTES = BLOCK_BYTES * BUFFER_BLOCKS;
+    static constexpr size_t DIV = BLOCK_BYTES / sizeof(result_type);
+
+    alignas(64) uint8_t buf_[BUFFER_BYTES];
+    uint64_t next_;   // Counter of the first block after the buffer.
+    size_t   offset_; // Bytes of buf_ already consumed.
+    uint64_t seed_, stream_;
+
+    Derived       &derived()       {return *static_cast<Derived *>(this);}
+    const Derived &derived() const {return *static_cast<const Derived *>(this);}
+    void refill() {
+        derived().generate_blocks(next_, BUFFER_BLOCKS, buf_);
+        next_ += BUFFER_BLOCKS;
+        offset_ = 0;
+    }
+    void restart(uint64_t block) {
+        next_ = block;
+        offset_ = BUFFER_BYTES;
+    }
+    static constexpr size_t roundup_result(size_t nbytes) {
+        return (nbytes + sizeof(result_type) - 1) / sizeof(result_type) * sizeof(result_type);
+    }
+    CounterRNG(uint64_t seed, uint64_t stream): next_(0), offset_(BUFFER_BYTES), seed_(seed), stream_(stream) {}
+public:
+    static constexpr result_type min() {return std::numeric_limits<result_type>::min();}
+    static constexpr result_type max() {return std::numeric_limits<result_type>::max();}
+
+    result_type operator()() {
+        if(__builtin_expect(offset_ >= BUFFER_BYTES, 0)) refill();
+        result_type ret;
+        std::memcpy(&ret, buf_ + offset_, sizeof(ret));
+        offset_ += sizeof(result_type);
+        return ret;
+    }
+    void seed(uint64_t seed) {
+        seed_ = seed;
+        derived().rekey();
+        restart(0);
+    }
+    // Switches to the start of substream `stream` under the same seed.
+    void set_stream(uint64_t stream) {
+        stream_ = stream;
+        derived().rekey();
+        restart(0);
+    }
+    uint64_t stream() const {return stream_;}
+    result_type operator[](uint64_t index) const {
+        alignas(16) result_type tmp[DIV];
+        derived().generate_blocks(index / DIV, 1, reinterpret_cast<uint8_t *>(tmp));
+        return tmp[index % DIV];
+    }
+    // Writes the next nbytes of the stream, as if values were drawn with operator() and copied out.
+    void fill(void *dst, size_t nbytes) {
+        uint8_t *out(static_cast<uint8_t *>(dst));
+        if(offset_ < BUFFER_BYTES) {
+            const size_t take(std::min(nbytes, BUFFER_BYTES - offset_));
+            std::memcpy(out, buf_ + offset_, take);
+            offset_ += roundup_result(take);
+            out += take, nbytes -= take;
+            if(nbytes == 0) return;
+        }
+        const size_t nblocks(nbytes / BLOCK_BYTES), rem(nbytes % BLOCK_BYTES);
+        derived().generate_blocks(next_, nblocks, out);
+        next_ += nblocks;
+        if(rem) {
+            refill();
+            std::memcpy(out + nblocks * BLOCK_BYTES, buf_, rem);
+            offset_ = roundup_result(rem);
+        }
+    }
+    // Writes values [start, start + count) of the stream to dst. The position is unchanged.
+    void generate_range(uint64_t start, size_t count, result_type *dst) const {
+        alignas(16) result_type tmp[DIV];
+        uint64_t block(start / DIV);
+        if(const size_t lead = start % DIV) {
+            const size_t n(std::min(DIV - lead, count));
+            derived().generate_blocks(block++, 1, reinterpret_cast<uint8_t *>(tmp));
+            std::memcpy(dst, tmp + lead, n * sizeof(result_type));
+            dst += n, count -= n;
+        }
+        const size_t nblocks(count / DIV);
+        derived().generate_blocks(block, nblocks, reinterpret_cast<uint8_t *>(dst));
+        if(const size_t rem = count % DIV) {
+            derived().generate_blocks(block + nblocks, 1, reinterpret_cast<uint8_t *>(tmp));
+            std::memcpy(dst + nblocks * DIV, tmp, rem * sizeof(result_type));
+        }
+    }
+    uint64_t position() const {
+        return (next_ - BUFFER_BLOCKS) * DIV + offset_ / sizeof(result_type);
+    }
+    void seek(uint64_t pos) {
+        restart(pos / DIV);
+        if(const size_t rem = pos % DIV) {
+            refill();
+            offset_ = rem * sizeof(result_type);
+        }
+    }
+    void jump(uint64_t n) {seek(position() + n);}
+    static std::pair<uint64_t, uint64_t> partition(size_t k, size_t nparts, uint64_t n) {
+        return aes::AesCtr<>::partition(k, nparts, n);
+    }
+    Derived split(size_t k, size_t nparts, uint64_t n) const {
+        Derived ret(derived());
+        ret.jump(partition(k, nparts, n).first);
+        return ret;
+    }
+};
+
+// Philox4x32 with ROUNDS rounds. Key: the 64-bit seed. Counter: (block index, stream).
+template<typename GeneratedType=uint64_t, size_t ROUNDS=10>
+class Philox4x32: public CounterRNG<Philox4x32<GeneratedType, ROUNDS>, GeneratedType, 16> {
+    using Base = CounterRNG<Philox4x32<GeneratedType, ROUNDS>, GeneratedType, 16>;
+    friend Base;
+    static constexpr uint32_t M0 = 0xD2511F53u, M1 = 0xCD9E8D57u, W0 = 0x9E3779B9u, W1 = 0xBB67AE85u;
+    uint32_t key_[2];
+
+    void rekey() {
+        key_[0] = static_cast<uint32_t>(this->seed_);
+        key_[1] = static_cast<uint32_t>(this->seed_ >> 32);
+    }
+    // One block at a time: the widening multiplies do not vectorize profitably,
+    // and independent blocks already overlap in the out-of-order window.
+    void generate_blocks(uint64_t ctr, size_t n, uint8_t *dst) const {
+        const uint32_t s0(static_cast<uint32_t>(this->stream_)), s1(static_cast<uint32_t>(this->stream_ >> 32));
+        for(size_t i = 0; i < n; ++i) {
+            uint32_t c0(static_cast<uint32_t>(ctr + i)), c1(static_cast<uint32_t>((ctr + i) >> 32)), c2(s0), c3(s1);
+            uint32_t k0(key_[0]), k1(key_[1]);
+            for(size_t r = 0; r < ROUNDS; ++r) {
+                const uint64_t p0(uint64_t(M0) * c0), p1(uint64_t(M1) * c2);
+                c0 = static_cast<uint32_t>(p1 >> 32) ^ c1 ^ k0;
+                c2 = static_cast<uint32_t>(p0 >> 32) ^ c3 ^ k1;
+                c1 = static_cast<uint32_t>(p1);
+                c3 = static_cast<uint32_t>(p0);
+                k0 += W0, k1 += W1;
+            }
+            const uint32_t out[4] {c0, c1, c2, c3};
+            std::memcpy(dst + 16 * i, out, sizeof(out));
+        }
+    }
+public:
+    Philox4x32(uint64_t seed=0, uint64_t stream=0): Base(seed, stream) {rekey();}
+};
+
+// wyrand (Wang Yi): value i is mum(s, s ^ P1) with s = key + (i + 1) * P0.
+// Stream 0 reproduces the reference wyrand sequence for the seed; other streams rehash the key.
+template<typename GeneratedType=uint64_t>
+class WyRand: public CounterRNG<WyRand<GeneratedType>, GeneratedType, 8> {
+    using Base = CounterRNG<WyRand<GeneratedType>, GeneratedType, 8>;
+    friend Base;
+    static constexpr uint64_t P0 = 0xa0761d6478bd642full, P1 = 0xe7037ed1a0b428dbull;
+    uint64_t key_;
+
+    static uint64_t mum(uint64_t a, uint64_t b) {
+        const __uint128_t r(static_cast<__uint128_t>(a) * b);
+        return static_cast<uint64_t>(r >> 64) ^ static_cast<uint64_t>(r);
+    }
+    void rekey() {
+        key_ = this->stream_ ? mum(this->seed_ ^ P0, this->stream_ ^ P1) ^ this->seed_: this->seed_;
+    }
+    void generate_blocks(uint64_t ctr, size_t n, uint8_t *dst) const {
+        uint64_t s(key_ + ctr * P0);
+        for(size_t i = 0; i < n; ++i) {
+            s += P0;
+            const uint64_t v(mum(s, s ^ P1));
+            std::memcpy(dst + 8 * i, &v, sizeof(v));
+        }
+    }
+public:
+    WyRand(uint64_t seed=0, uint64_t stream=0): Base(seed, stream) {rekey();}
+};
+
+// Generators whose values can be computed at any index and written in bulk:
+// AesCtr and the counter-based generators above.
+template<typename RNG, typename=void>
+struct is_counter_based: std::false_type {};
+template<typename RNG>
+struct is_counter_based<RNG, std::void_t<decltype(std::declval<RNG &>().fill(static_cast<void *>(nullptr), size_t(0))),
+                                         decltype(std::declval<const RNG &>()[uint64_t(0)])>>: std::true_type {};
+
+} // namespace rng
+
+#endif // #ifndef _GFRP_CTRNG_H__
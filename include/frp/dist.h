@@ -1,6 +1,7 @@
 #ifndef _GFRP_DIST_H__
 #define _GFRP_DIST_H__
 #include <random>
+#include <vector>
 #include "frp/rand.h"
 #include "frp/linalg.h"
 
@@ -27,9 +28,146 @@ void sample_fill(blaze::DynamicMatrix<FloatType, SO> &con, uint64_t seed, DistAr
 }
 
 
+namespace detail {
+
+template<typename RNG, typename=void>
+struct has_set_stream: std::false_type {};
+template<typename RNG>
+struct has_set_stream<RNG, std::void_t<decltype(std::declval<RNG &>().set_stream(uint64_t(0)))>>: std::true_type {};
+
+// Substream `index` of the generator seeded with `seed`.
+// Counter-based generators select it through the upper counter bits, so substreams never overlap.
+// Other generators are reseeded with a mixed seed. Substream 0 is always RNG(seed).
+template<typename RNG>
+RNG make_substream(uint64_t seed, uint64_t index) {
+    if constexpr(has_set_stream<RNG>::value) {
+        RNG ret(seed);
+        if(index) ret.set_stream(index);
+        return ret;
+    } else {
+        if(index == 0) return RNG(seed);
+        uint64_t z(seed + index * 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return RNG(z ^ (z >> 31));
+    }
+}
+
+} // namespace detail
+
+// Elements per independently-seeded chunk in chunked fills.
+static constexpr size_t SAMPLE_FILL_CHUNK = size_t(1) << 14;
+// Bulk samplers (see below) are called on runs of this many elements within a chunk,
+// so implicit blocks that regenerate values in small buffers reproduce chunked fills exactly.
+static constexpr size_t SAMPLE_FILL_BLOCK = 256;
+
+namespace detail {
+
+template<typename Dist, typename FloatType, typename RNG, typename=void>
+struct has_bulk_fill: std::false_type {};
+template<typename Dist, typename FloatType, typename RNG>
+struct has_bulk_fill<Dist, FloatType, RNG,
+                     std::void_t<decltype(std::declval<Dist &>().fill(std::declval<FloatType *>(), size_t(0), std::declval<RNG &>()))>>: std::true_type {};
+
+// Draws n values from dist, through its bulk fill in SAMPLE_FILL_BLOCK runs when it has one.
+template<typename Dist, typename FloatType, typename RNG>
+void draw(Dist &dist, FloatType *data, size_t n, RNG &gen) {
+    if constexpr(has_bulk_fill<Dist, FloatType, RNG>::value) {
+        for(size_t i(0); i < n; i += SAMPLE_FILL_BLOCK) dist.fill(data + i, std::min(SAMPLE_FILL_BLOCK, n - i), gen);
+    } else {
+        for(size_t i(0); i < n; data[i++] = dist(gen));
+    }
+}
+
+} // namespace detail
+
+// Fills data[0, n) in fixed-size chunks, in parallel.
+// Chunk c is generated by fill(ptr, len, gen) from substream c of seed,
+// so the result does not depend on the number of threads, and containers
+// of up to SAMPLE_FILL_CHUNK elements match a serial fill from RNG(seed).
+template<typename RNG=aes::AesCtr<uint64_t>, typename FloatType, typename ChunkFiller>
+void chunked_fill(FloatType *data, size_t n, uint64_t seed, const ChunkFiller &fill) {
+    const int64_t nchunks((n + SAMPLE_FILL_CHUNK - 1) / SAMPLE_FILL_CHUNK);
+    #pragma omp parallel for schedule(static) if(nchunks > 1)
+    for(int64_t c = 0; c < nchunks; ++c) {
+        RNG gen(detail::make_substream<RNG>(seed, c));
+        const size_t start(c * SAMPLE_FILL_CHUNK);
+        fill(data + start, std::min(SAMPLE_FILL_CHUNK, n - start), gen);
+    }
+}
+
+template<template<typename> typename Distribution, typename RNG=aes::AesCtr<uint64_t>, typename FloatType, typename... DistArgs>
+void chunked_sample_fill_n(FloatType *data, size_t n, uint64_t seed, DistArgs &&... args) {
+    const Distribution<FloatType> dist(forward<DistArgs>(args)...);
+    chunked_fill<RNG>(data, n, seed, [&dist](FloatType *data, size_t n, RNG &gen) {
+        auto d(dist);
+        detail::draw(d, data, n, gen);
+    });
+}
+
+template<typename Container, template<typename> typename Distribution, typename RNG=aes::AesCtr<uint64_t>, typename... DistArgs>
+void chunked_sample_fill(Container &con, uint64_t seed, DistArgs &&... args) {
+    if(con.size() == 0) return;
+    if(con.size() > 1 && &con[1] - &con[0] != 1) throw std::runtime_error("chunked_sample_fill requires contiguous storage.");
+    chunked_sample_fill_n<Distribution, RNG>(&con[0], con.size(), seed, forward<DistArgs>(args)...);
+}
+
+// chunked_fill over nlines lines of len elements each, spaced `spacing` apart, as if they were contiguous.
+// Chunks are numbered by the logical (unpadded) index, so padding never changes the values.
+// A chunk that crosses lines is generated into a buffer and scattered.
+template<typename RNG=aes::AesCtr<uint64_t>, typename FloatType, typename ChunkFiller>
+void chunked_fill_lines(FloatType *data, size_t nlines, size_t len, size_t spacing, uint64_t seed, const ChunkFiller &fill) {
+    if(spacing == len) {
+        chunked_fill<RNG>(data, nlines * len, seed, fill);
+        return;
+    }
+    const size_t n(nlines * len);
+    const int64_t nchunks((n + SAMPLE_FILL_CHUNK - 1) / SAMPLE_FILL_CHUNK);
+    #pragma omp parallel if(nchunks > 1)
+    {
+        std::vector<FloatType> buf;
+        #pragma omp for schedule(static)
+        for(int64_t c = 0; c < nchunks; ++c) {
+            RNG gen(detail::make_substream<RNG>(seed, c));
+            const size_t start(c * SAMPLE_FILL_CHUNK), clen(std::min(SAMPLE_FILL_CHUNK, n - start));
+            const size_t line(start / len), offset(start % len);
+            if(offset + clen <= len) {
+                fill(data + line * spacing + offset, clen, gen);
+                continue;
+            }
+            buf.resize(clen);
+            fill(buf.data(), clen, gen);
+            for(size_t i(0); i < clen;) {
+                const size_t li((start + i) / len), lo((start + i) % len), take(std::min(len - lo, clen - i));
+                std::copy(&buf[i], &buf[i + take], data + li * spacing + lo);
+                i += take;
+            }
+        }
+    }
+}
+
+// Matrices are sampled in storage order as if unpadded.
+template<template<typename> typename Distribution, typename RNG=aes::AesCtr<uint64_t>, typename FloatType, bool SO, typename... DistArgs>
+void chunked_sample_fill(blaze::DynamicMatrix<FloatType, SO> &con, uint64_t seed, DistArgs &&... args) {
+    const size_t nlines(SO == blaze::rowMajor ? con.rows(): con.columns()), len(SO == blaze::rowMajor ? con.columns(): con.rows());
+    if(nlines * len == 0) return;
+    const Distribution<FloatType> dist(forward<DistArgs>(args)...);
+    chunked_fill_lines<RNG>(con.data(), nlines, len, con.spacing(), seed, [&dist](FloatType *data, size_t n, RNG &gen) {
+        auto d(dist);
+        detail::draw(d, data, n, gen);
+    });
+}
+
 template<typename RNG=aes::AesCtr<uint64_t>>
 void random_fill(uint64_t *data, uint64_t len, uint64_t seed=0) {
-    for(RNG gen(seed); len; data[--len] = gen());
+    if constexpr(rng::is_counter_based<RNG>::value && sizeof(typename RNG::result_type) == sizeof(uint64_t)) {
+        // Bulk-generate, then reverse to keep the order of the scalar loop below.
+        RNG gen(seed);
+        gen.fill(data, len * sizeof(uint64_t));
+        std::reverse(data, data + len);
+    } else {
+        for(RNG gen(seed); len; data[--len] = gen());
+    }
 }
 
 #define DEFINE_DIST_FILL(type, name) \
@@ -41,6 +179,15 @@ void random_fill(uint64_t *data, uint64_t len, uint64_t seed=0) {
     void name##_fill(blaze::DynamicMatrix<FloatType, SO> &con, uint64_t seed, Args &&... args) { \
         sample_fill<FloatType, SO, type, RNG, Args...>(con, seed, forward<Args>(args)...); \
     }\
+    /* Parallel fills: the same values on any number of threads (see chunked_fill). */ \
+    template<typename Container, typename RNG=aes::AesCtr<uint64_t>, typename...Args> \
+    void name##_fill_parallel(Container &con, uint64_t seed, Args &&... args) { \
+        chunked_sample_fill<Container, type, RNG>(con, seed, forward<Args>(args)...); \
+    }\
+    template<typename FloatType, bool SO, typename RNG=aes::AesCtr<uint64_t>, typename...Args> \
+    void name##_fill_parallel(blaze::DynamicMatrix<FloatType, SO> &con, uint64_t seed, Args &&... args) { \
+        chunked_sample_fill<type, RNG>(con, seed, forward<Args>(args)...); \
+    }\
     struct name##_fill_struct {\
         template<typename Container, typename RNG=aes::AesCtr<uint64_t>, typename...Args>\
         void operator()(Container &con, uint64_t seed, Args &&... args) const {\
@@ -54,6 +201,215 @@ public:
     void reset() {}
 };
 
+/*
+ * Bulk samplers.
+ * fill(data, n, gen) turns whole buffers of generator output into samples:
+ * uniforms come straight from the random bits, Gaussians from a Box-Muller transform
+ * evaluated with SIMD log/sincos, and gamma/chi-squared variates from Marsaglia and Tsang's
+ * squeeze method on batches of candidates.
+ * They are different samplers from boost's, so they do not reproduce its values for a seed.
+ * Single values are available through operator() for compatibility, but are not fast.
+ * Generators are assumed to produce uniformly random words over their full range.
+ */
+namespace detail {
+
+template<typename FloatType>
+static constexpr bool has_fast_sampler = std::is_same<FloatType, float>::value || std::is_same<FloatType, double>::value;
+
+// Copies the next nbytes of gen's output to dst, in bulk for counter-based generators.
+template<typename RNG>
+void fill_random_bytes(RNG &gen, void *dst, size_t nbytes) {
+    if constexpr(rng::is_counter_based<RNG>::value) {
+        gen.fill(dst, nbytes);
+    } else {
+        using ResultType = typename RNG::result_type;
+        uint8_t *ptr(static_cast<uint8_t *>(dst));
+        for(; nbytes >= sizeof(ResultType); ptr += sizeof(ResultType), nbytes -= sizeof(ResultType)) {
+            const ResultType v(gen());
+            std::memcpy(ptr, &v, sizeof(v));
+        }
+        if(nbytes) {
+            const ResultType v(gen());
+            std::memcpy(ptr, &v, nbytes);
+        }
+    }
+}
+
+// Uniforms on the open interval (0, 1), from the top 24 (float) or 53 (double) bits of each word.
+// Bits are generated into data and converted in place.
+template<typename FloatType, typename RNG>
+void fill_open_uniform(FloatType *data, size_t n, RNG &gen) {
+    using Bits = std::conditional_t<sizeof(FloatType) == 4, uint32_t, uint64_t>;
+    static constexpr int SHIFT = sizeof(Bits) * CHAR_BIT - std::numeric_limits<FloatType>::digits;
+    static constexpr FloatType SCALE = FloatType(1) / (Bits(1) << std::numeric_limits<FloatType>::digits);
+    fill_random_bytes(gen, data, n * sizeof(FloatType));
+    for(size_t i(0); i < n; ++i) {
+        Bits b;
+        std::memcpy(&b, data + i, sizeof(b));
+        data[i] = static_cast<FloatType>(b >> SHIFT) * SCALE + SCALE / 2;
+    }
+}
+
+template<typename FloatType>
+inline void box_muller(FloatType &u1, FloatType &u2) {
+    const FloatType r(std::sqrt(-2 * std::log(u1))), theta(static_cast<FloatType>(2 * M_PI) * u2);
+    u1 = r * std::cos(theta);
+    u2 = r * std::sin(theta);
+}
+
+// Standard normals. Each pack of 2 * COUNT uniforms becomes 2 * COUNT normals,
+// the first COUNT from cosines and the second COUNT from sines.
+template<typename FloatType, typename RNG>
+void fill_unit_normal(FloatType *data, size_t n, RNG &gen) {
+    using Space = vec::SIMDTypes<FloatType>;
+    static constexpr size_t W = Space::COUNT;
+    const size_t even(n & ~size_t(1));
+    fill_open_uniform(data, even, gen);
+    const typename Space::Type m2(Space::set1(-2.)), tau(Space::set1(2. * M_PI));
+    size_t i(0);
+    for(; i + 2 * W <= even; i += 2 * W) {
+        const auto r(Space::sqrt_u05(Space::mul(m2, Space::log_u10(Space::loadu(data + i)))));
+        const auto sc(Space::sincos_u10(Space::mul(tau, Space::loadu(data + i + W))));
+        Space::storeu(data + i,     Space::mul(r, sc.y));
+        Space::storeu(data + i + W, Space::mul(r, sc.x));
+    }
+    for(; i < even; i += 2) box_muller(data[i], data[i + 1]);
+    if(n & 1) {
+        FloatType pair[2];
+        fill_open_uniform(pair, 2, gen);
+        box_muller(pair[0], pair[1]);
+        data[n - 1] = pair[0];
+    }
+}
+
+// Gamma(shape, 1) variates (Marsaglia and Tsang, 2000).
+// The cheap squeeze accepts almost every candidate, so the logarithms are rarely evaluated.
+// Shapes below one are boosted to shape + 1 and multiplied by U^(1 / shape).
+template<typename FloatType, typename RNG>
+void fill_gamma(FloatType *data, size_t n, FloatType shape, RNG &gen) {
+    static constexpr size_t NCANDIDATES = 64;
+    const bool boost_shape(shape < 1);
+    const FloatType d((boost_shape ? shape + 1: shape) - FloatType(1) / 3), c(1 / std::sqrt(9 * d));
+    FloatType x[NCANDIDATES], u[NCANDIDATES];
+    for(size_t i(0), pos(NCANDIDATES); i < n;) {
+        if(pos == NCANDIDATES) {
+            fill_unit_normal(x, NCANDIDATES, gen);
+            fill_open_uniform(u, NCANDIDATES, gen);
+            pos = 0;
+        }
+        const FloatType xv(x[pos]), uv(u[pos++]);
+        FloatType v(1 + c * xv);
+        if(v <= 0) continue;
+        v = v * v * v;
+        const FloatType x2(xv * xv);
+        if(uv < 1 - FloatType(0.0331) * x2 * x2 || std::log(uv) < x2 / 2 + d * (1 - v + std::log(v)))
+            data[i++] = d * v;
+    }
+    if(boost_shape) {
+        const FloatType inv(1 / shape);
+        for(size_t i(0); i < n; i += NCANDIDATES) {
+            const size_t len(std::min(NCANDIDATES, n - i));
+            fill_open_uniform(u, len, gen);
+            for(size_t j(0); j < len; ++j) data[i + j] *= std::pow(u[j], inv);
+        }
+    }
+}
+
+} // namespace detail
+
+template<typename FloatType>
+class fast_uniform {
+    FloatType a_, b_;
+public:
+    fast_uniform(FloatType a=0, FloatType b=1): a_(a), b_(b) {}
+    template<typename RNG>
+    void fill(FloatType *data, size_t n, RNG &gen) const {
+        if constexpr(detail::has_fast_sampler<FloatType>) {
+            detail::fill_open_uniform(data, n, gen);
+            if(a_ != 0 || b_ != 1) for(size_t i(0); i < n; ++i) data[i] = a_ + (b_ - a_) * data[i];
+        } else {
+            boost::random::uniform_real_distribution<FloatType> dist(a_, b_);
+            for(size_t i(0); i < n; data[i++] = dist(gen));
+        }
+    }
+    template<typename RNG>
+    FloatType operator()(RNG &gen) const {FloatType ret; fill(&ret, 1, gen); return ret;}
+    void reset() {}
+};
+
+template<typename FloatType>
+class fast_normal {
+    FloatType mean_, sigma_;
+public:
+    fast_normal(FloatType mean=0, FloatType sigma=1): mean_(mean), sigma_(sigma) {}
+    template<typename RNG>
+    void fill(FloatType *data, size_t n, RNG &gen) const {
+        if constexpr(detail::has_fast_sampler<FloatType>) {
+            detail::fill_unit_normal(data, n, gen);
+            if(mean_ != 0 || sigma_ != 1) for(size_t i(0); i < n; ++i) data[i] = mean_ + sigma_ * data[i];
+        } else {
+            boost::normal_distribution<FloatType> dist(mean_, sigma_);
+            for(size_t i(0); i < n; data[i++] = dist(gen));
+        }
+    }
+    template<typename RNG>
+    FloatType operator()(RNG &gen) const {FloatType ret; fill(&ret, 1, gen); return ret;}
+    void reset() {}
+};
+
+template<typename FloatType>
+class fast_unit_normal: public fast_normal<FloatType> {
+public:
+    fast_unit_normal(): fast_normal<FloatType>(0, 1) {}
+};
+
+template<typename FloatType>
+class fast_gamma {
+    FloatType shape_, scale_;
+public:
+    fast_gamma(FloatType shape=1, FloatType scale=1): shape_(shape), scale_(scale) {
+        if(!(shape > 0)) throw std::runtime_error("Gamma shape must be positive.");
+    }
+    template<typename RNG>
+    void fill(FloatType *data, size_t n, RNG &gen) const {
+        if constexpr(detail::has_fast_sampler<FloatType>) {
+            detail::fill_gamma(data, n, shape_, gen);
+            if(scale_ != 1) for(size_t i(0); i < n; data[i++] *= scale_);
+        } else {
+            boost::random::gamma_distribution<FloatType> dist(shape_, scale_);
+            for(size_t i(0); i < n; data[i++] = dist(gen));
+        }
+    }
+    template<typename RNG>
+    FloatType operator()(RNG &gen) const {FloatType ret; fill(&ret, 1, gen); return ret;}
+    void reset() {}
+};
+
+// Chi-squared with dof degrees of freedom is Gamma(dof / 2, 2).
+template<typename FloatType>
+class fast_chi_squared: public fast_gamma<FloatType> {
+public:
+    fast_chi_squared(FloatType dof=1): fast_gamma<FloatType>(dof / 2, 2) {}
+};
+
+// Like DEFINE_DIST_FILL, but fast_##name##_fill draws with a bulk sampler in parallel chunks (see chunked_fill).
+// The result depends only on the seed, not on the number of threads.
+#define DEFINE_FAST_DIST_FILL(type, name) \
+    template<typename Container, typename RNG=aes::AesCtr<uint64_t>, typename...Args> \
+    void fast_##name##_fill(Container &con, uint64_t seed, Args &&... args) { \
+        chunked_sample_fill<Container, type, RNG>(con, seed, forward<Args>(args)...); \
+    }\
+    template<typename FloatType, bool SO, typename RNG=aes::AesCtr<uint64_t>, typename...Args> \
+    void fast_##name##_fill(blaze::DynamicMatrix<FloatType, SO> &con, uint64_t seed, Args &&... args) { \
+        chunked_sample_fill<type, RNG>(con, seed, forward<Args>(args)...); \
+    }\
+    struct fast_##name##_fill_struct {\
+        template<typename Container, typename RNG=aes::AesCtr<uint64_t>, typename...Args>\
+        void operator()(Container &con, uint64_t seed, Args &&... args) const {\
+            fast_##name##_fill<Container, RNG, Args...>(con, seed, forward<Args>(args)...);\
+        }\
+    };
+
 DEFINE_DIST_FILL(boost::normal_distribution, gaussian)
 DEFINE_DIST_FILL(unit_normal, unit_gaussian)
 DEFINE_DIST_FILL(boost::cauchy_distribution, cauchy)
@@ -63,6 +419,12 @@ DEFINE_DIST_FILL(boost::random::extreme_value_distribution, extreme_value)
 DEFINE_DIST_FILL(boost::random::weibull_distribution, weibull)
 DEFINE_DIST_FILL(boost::random::uniform_real_distribution, uniform)
 
+DEFINE_FAST_DIST_FILL(fast_normal, gaussian)
+DEFINE_FAST_DIST_FILL(fast_unit_normal, unit_gaussian)
+DEFINE_FAST_DIST_FILL(fast_chi_squared, chisq)
+DEFINE_FAST_DIST_FILL(fast_gamma, gamma)
+DEFINE_FAST_DIST_FILL(fast_uniform, uniform)
+
 }
 
 #endif // #ifndef _GFRP_DIST_H__
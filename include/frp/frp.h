@@ -13,6 +13,7 @@
 #include "frp/stackstruct.h"
 #include "frp/jl.h"
 #include "frp/aesctr.h"
+#include "frp/ctrng.h"
 #include "frp/parser.h"
 #include "frp/kernel.h"
 
@@ -50,7 +50,7 @@ public:
     {
         aes::AesCtr<uint64_t> gen(seed);
         while(seeds_.size() < nblocks) seeds_.push_back(gen());
-        for(const auto seed: seeds_) blocks_.emplace_back(from, seed);
+        for(const auto seed: seeds_) blocks_.emplace_back(from, seed, false);
     }
     void resize(size_type newfrom, size_type newto) {
         //std::fprintf(stderr, "Resizing from %zu to %zu (rounded up %zu)\n", from_, roundup(newfrom), newfrom);
@@ -76,6 +76,11 @@ public:
         to_ = newto;
     }
     size_t nblocks() const {return blocks_.size();}
+    // The blocks' Hadamards are unnormalized, so their from^{-1/2} factors are folded
+    // into the final sqrt(from / to) rescaling instead of costing a pass each.
+    double output_scale() const {
+        return std::sqrt(static_cast<double>(from_) / to_) * std::pow(static_cast<double>(from_), -0.5 * nblocks());
+    }
     template<typename Vec1, typename Vec2>
     void transform(const Vec1 &in, Vec2 &out) const {
         Vec2 tmp(in); // Copy.
@@ -87,24 +92,39 @@ public:
         for(auto it(std::rbegin(blocks_)), eit(std::rend(blocks_)); it != eit; ++it) {
             it->apply(in);
         }
-        in *= std::sqrt(static_cast<double>(from_) / to_);
+        in *= output_scale();
     }
     template<typename FloatType, typename=std::enable_if_t<std::is_floating_point<FloatType>::value>>
     void transform_inplace(FloatType *in) const {
         for(auto it(std::rbegin(blocks_)), eit(std::rend(blocks_)); it != eit; (it++)->apply(in)); // Apply transforms
         // Renormalize.
         using SType = typename vec::SIMDTypes<FloatType>;
-        const FloatType *end(in + to_);
-        const typename SType::Type vmul = SType::set1(std::sqrt(static_cast<FloatType>(from_) / to_));
+        const FloatType mul(output_scale());
+        const typename SType::Type vmul = SType::set1(mul);
+        const FloatType *end(in + to_), *vend(in + (to_ / SType::COUNT) * SType::COUNT);
         if(SType::aligned(in)) {
-            do {
-                SType::store(in, SType::mul(SType::load(in), vmul));
-            } while(++in < end);
+            for(; in < vend; in += SType::COUNT) SType::store(in, SType::mul(SType::load(in), vmul));
         } else {
-            do {
-                SType::storeu(in, SType::mul(SType::loadu(in), vmul));
-            } while(++in < end);
+            for(; in < vend; in += SType::COUNT) SType::storeu(in, SType::mul(SType::loadu(in), vmul));
         }
+        while(in < end) *in++ *= mul;
+    }
+    // Adjoint of transform: maps a to_size() vector back to from_size().
+    // transform computes P * c * B_0 * ... * B_{k-1} * x, where P keeps the first to_ rows,
+    // so this zero-pads, scales by c and applies each block's transpose, first block first.
+    template<typename Vec1, typename Vec2>
+    void transform_adjoint(const Vec1 &in, Vec2 &out) const {
+        if(in.size() < to_) throw std::runtime_error(ks::sprintf("Input (%zu) is smaller than the output dimension (%zu).", in.size(), to_).data());
+        if(out.size() != from_) throw std::runtime_error(ks::sprintf("Output (%zu) must have the input dimension (%zu).", out.size(), from_).data());
+        subvector(out, 0, to_) = subvector(in, 0, to_);
+        transform_adjoint_inplace(out);
+    }
+    // in must have from_size() elements, of which only the first to_size() are read.
+    template<typename Vec1, typename=std::enable_if_t<blaze::IsVector<Vec1>::value>>
+    void transform_adjoint_inplace(Vec1 &in) const {
+        blaze::reset(subvector(in, to_, in.size() - to_));
+        subvector(in, 0, to_) *= output_scale();
+        for(const auto &block: blocks_) block.apply_transpose(in);
     }
     // Downstream application has to subsample itself.
     // Optionally add a (potentially scaled?) Guassian multiplication layer.
@@ -16,7 +16,6 @@ public:
 
     template<typename VecType>
     void apply(VecType &in) const {
-        if((in.size() & (in.size() - 1))) std::fprintf(stderr, "in.size() [%zu] is not a power of 2.\n", in.size()), exit(1);
         using FloatType = typename std::decay_t<decltype(in[0])>;
 #if 1
         using SIMDType  = vec::SIMDTypes<FloatType>;
@@ -25,6 +24,17 @@ public:
         static const size_t ratio(sizeof(VT) / sizeof(FloatType));
         DT dest;
         VT *srcptr((VT *)&in[0]);
+        {
+            // Sizes that are not a multiple of two SIMD packs (e.g., from DCT kernels) leave a short final pack.
+            // It is written last in the interleaved layout, so it is handled first, before the packs are spread out.
+            const size_t half(in.size() >> 1), packed((half / ratio) * ratio), tail(half - packed);
+            FloatType vals[sizeof(VT) / sizeof(FloatType)];
+            for(size_t i(0); i < tail; ++i) vals[i] = in[packed + i];
+            for(size_t i(0); i < tail; ++i) {
+                in[(packed << 1) + i]        = std::sin(vals[i]);
+                in[(packed << 1) + tail + i] = std::cos(vals[i]);
+            }
+        }
         if(use_lowprec_) {
             if constexpr(IS_CONTIGUOUS_UNCOMPRESSED_BLAZE(VecType)) {
                 for(u32 i((in.size() >> 1) / ratio); i;) {
@@ -113,32 +123,34 @@ public:
 
 namespace ff {
 
-template<typename FloatType, typename RademType=CompactRademacher>
+template<typename FloatType, typename RademType=CompactRademacher,
+         typename ChiScalingType=RandomChiScalingBlock<FloatType>,
+         typename GaussianScalingType=UnitGaussianScalingBlock<FloatType>,
+         typename ShufflerType=LutShuffler<uint32_t>>
 class KernelBlock {
 protected:
     size_t final_output_size_; // This is twice the size passed to the Hadamard transforms
-    using RandomScalingBlock = RandomChiScalingBlock<FloatType>;
-    using SizeType = uint32_t;
-    using Shuffler = LutShuffler<SizeType>;
+    using RandomScalingBlock = ChiScalingType;
+    using Shuffler = ShufflerType;
     using SpinTransformer =
         SpinBlockTransformer<FastFoodGaussianProductBlock<FloatType>,
                              RandomScalingBlock, HadamardBlock,
-                             UnitGaussianScalingBlock<FloatType>, Shuffler, HadamardBlock,
+                             GaussianScalingType, Shuffler, HadamardBlock,
                              RademType>;
     SpinTransformer tx_;
 
 public:
     using float_type = FloatType;
-    using GaussianMatrixType = UnitGaussianScalingBlock<FloatType>;
+    using GaussianMatrixType = GaussianScalingType;
     KernelBlock(size_t size, uint64_t seed=-1, FloatType sigma=1., bool renorm=true):
         final_output_size_(size),
         tx_(
             std::make_tuple(FastFoodGaussianProductBlock<FloatType>(sigma),
                    RandomScalingBlock(seed + seed * seed - size * size, size),
-                   HadamardBlock(size, renorm),
+                   HadamardBlock(size, false),
                    GaussianMatrixType(seed * seed, size),
                    Shuffler(size, seed),
-                   HadamardBlock(size, renorm),
+                   HadamardBlock(size, false),
                    RademType(size, (seed ^ (size * size)) + seed)))
     {
         if(final_output_size_ & (final_output_size_ - 1)) {
@@ -148,7 +160,8 @@ public:
         }
         auto &rsbref(std::get<RandomScalingBlock>(tx_.get_tuple()));
         auto &gmref(std::get<GaussianMatrixType>(tx_.get_tuple()));
-        rsbref.rescale(float_type(size)/std::sqrt(gmref.vec_norm()));
+        // The two Hadamards are unnormalized; with renorm, their 1/n is folded in here.
+        rsbref.rescale((renorm ? float_type(1): float_type(size))/std::sqrt(gmref.vec_norm()));
     }
     size_t transform_size() const {return final_output_size_;}
 #if 0
@@ -179,6 +192,11 @@ public:
     }
 };
 
+// FastFood with every block regenerated from its seed, so each block takes constant memory.
+template<typename FloatType>
+using ImplicitKernelBlock = KernelBlock<FloatType, PRNRademacher, PRNChiScalingBlock<FloatType>,
+                                        PRNUnitGaussianScalingBlock<FloatType>, OnlineShuffler<uint32_t>>;
+
 } // namespace ff
 
 namespace sorf {
@@ -199,8 +217,9 @@ public:
             ::std::cerr << s; throw std::runtime_error(s);
         }
         while(blocks_.size() < nblocks)
-            blocks_.emplace_back(std::make_pair(HadamardBlock(),
+            blocks_.emplace_back(std::make_pair(HadamardBlock(size, false),
                                  RademType(size, seed++)));
+        sorf_.rescale(std::pow(static_cast<double>(size), -0.5 * nblocks)); // Hadamard normalization, folded.
     }
     size_t transform_size() const {return final_output_size_;}
     template<typename InputType, typename OutputType>
@@ -218,6 +237,20 @@ public:
         for(auto &pair: blocks_) pair.second.apply(out), pair.first.apply(out);
         sorf_.apply(out);
     }
+    // Batch version: each row of in is an input vector, and the matching row of out receives its transform.
+    // Hadamards go through fht_batch, so small dimensions use the unrolled kernels.
+    template<typename InputType, typename OutputType>
+    void apply_many(OutputType &out, const InputType &in) const {
+        static_assert(blaze::IsDenseMatrix<OutputType>::value, "apply_many expects a dense output matrix.");
+        if(out.columns() != final_output_size_ || out.rows() != in.rows())
+            throw std::runtime_error(ks::sprintf("Wrong output shape for sorf::KernelBlock: %zu x %zu, not %zu x %zu.",
+                                                 out.rows(), out.columns(), in.rows(), final_output_size_).data());
+        if(roundup(in.columns()) != transform_size()) throw std::runtime_error("Input dimension does not round up to the transform size.");
+        blaze::reset(out);
+        submatrix(out, 0, 0, in.rows(), in.columns()) = in;
+        for(auto &pair: blocks_) apply_diagonal_rows(pair.second, out), pair.first.apply(out);
+        sorf_.apply_many(out);
+    }
 };
 
 template<typename FloatType, typename RademType=CompactRademacher>
@@ -236,18 +269,74 @@ public:
     }
 };
 
+/*
+ * SORF with orthonormal DCTs in place of Hadamards: x -> (sqrt(n) / sigma) * prod_b (C_b D_b) x,
+ * where the C_b alternate between DCT-II and DCT-III and the D_b are Rademacher diagonals.
+ * Every factor is orthogonal, so the product is too, and any n works without padding to a power of two.
+ * Sizes with small prime factors are fastest (see fft::good_size).
+ * RademType must support arbitrary sizes, which CompactRademacher does not.
+ */
+template<typename FloatType, typename RademType=PRNRademacher>
+class DCTKernelBlock {
+protected:
+    const size_t final_output_size_;
+    SORFProductBlock<FloatType> sorf_;
+    DCTBlock<FloatType>          dct_;
+    IDCTBlock<FloatType>        idct_;
+    std::vector<RademType>     signs_;
+public:
+    using float_type = FloatType;
+    DCTKernelBlock(size_t size, uint64_t seed=-1,
+                   FloatType sigma=1., size_t nblocks=3):
+        final_output_size_(size), sorf_(sigma),
+        dct_(size, false, FFTW_MEASURE, true), idct_(size, false, FFTW_MEASURE, true)
+    {
+        if(nblocks == 0) {
+            const char *s = "Need more than 0 blocks for sorf::DCTKernelBlock. (Recommended: 3.)\n";
+            ::std::cerr << s; throw std::runtime_error(s);
+        }
+        while(signs_.size() < nblocks) signs_.emplace_back(size, seed++);
+    }
+    size_t transform_size() const {return final_output_size_;}
+    template<typename InputType, typename OutputType>
+    void apply(OutputType &out, const InputType &in) const {
+        if(out.size() != final_output_size_ || in.size() > final_output_size_)
+            throw std::runtime_error(ks::sprintf("[%s] Wrong sizes (in: %zu, out: %zu, transform: %zu).",
+                                                 __PRETTY_FUNCTION__, in.size(), out.size(), final_output_size_).data());
+        if(&out[0] != &in[0]) subvector(out, 0, in.size()) = in;
+        blaze::reset(subvector(out, in.size(), out.size() - in.size()));
+        for(size_t i(0); i < signs_.size(); ++i) {
+            signs_[i].apply(out);
+            if(i & 1) idct_.apply(out);
+            else      dct_.apply(out);
+        }
+        sorf_.apply(out);
+    }
+};
+
 } // namespace sorf
 
+// Whether Kernel zero-pads inputs to a power of two for this kind of block.
+template<typename KernelBlock>
+struct pads_to_power_of_two: std::true_type {};
+template<typename FloatType, typename RademType>
+struct pads_to_power_of_two<sorf::DCTKernelBlock<FloatType, RademType>>: std::false_type {};
+
+template<typename KernelBlock>
+size_t kernel_input_size(size_t n) {
+    return pads_to_power_of_two<KernelBlock>::value ? static_cast<size_t>(roundup(n)): n;
+}
+
 namespace orf {
 
 namespace detail {
 template<typename FloatType>
 auto make_q(size_t size, FloatType sigma, uint64_t seed=0) {
     blaze::DynamicMatrix<FloatType> randg(size, size);
-    unit_gaussian_fill(randg, seed);
+    fast_unit_gaussian_fill(randg, seed);
     auto ret(linalg::qr_gram_schmidt(randg, linalg::ORTHONORMALIZE));
     blaze::DynamicVector<FloatType> SV(size);
-    chisq_fill(SV, seed++);
+    fast_chisq_fill(SV, seed++);
     SV = sqrt(SV);
     blaze::DiagonalMatrix<blaze::DynamicMatrix<FloatType>> S(size);
     for(size_t i(0); i < SV.size(); ++i) S(i,i) = SV[i];
@@ -304,7 +393,7 @@ public:
             unit_gaussian_fill(mrow, seed++);
         }
 #else
-        unit_gaussian_fill(matrix_, seed);
+        fast_unit_gaussian_fill(matrix_, seed);
 #endif
         matrix_ *= 1./sigma;
     }
@@ -349,7 +438,7 @@ public:
         , sigma_(sigma)
 #endif
     {
-        size_t input_ru = roundup(input_size);
+        size_t input_ru = kernel_input_size<KernelBlock>(input_size);
         stacked_size = std::max(stacked_size, input_ru);
         if(stacked_size % input_ru)
             stacked_size = input_ru - (stacked_size % input_ru);
@@ -366,18 +455,18 @@ public:
 
     template<typename OutputType>
     void apply(OutputType &out, size_t nelem) const {
-        size_t in_rounded(roundup(nelem));
+        size_t in_rounded(kernel_input_size<KernelBlock>(nelem));
         blaze::DynamicVector<FloatType> tmp(nelem);
         tmp = ::blaze::subvector(out, 0, nelem);
         if(out.size() != (blocks_.size() << 1) * in_rounded) {
             if constexpr(blaze::IsView<OutputType>::value) {
                 auto ks(ks::sprintf("[%s] Wanted to resize out block from %zu to %zu to match %zu input and %zu rounded up input.\n",
-                                    __PRETTY_FUNCTION__, out.size(), (blocks_.size() << 1) * in_rounded, nelem, static_cast<size_t>(roundup(nelem))));
+                                    __PRETTY_FUNCTION__, out.size(), (blocks_.size() << 1) * in_rounded, nelem, static_cast<size_t>(kernel_input_size<KernelBlock>(nelem))));
                 ks.write(stderr);
                 throw std::runtime_error(ks.data());
             } else {
                 std::fprintf(stderr, "Resizing out block from %zu to %zu to match %zu input and %zu rounded up input.\n",
-                             out.size(), (blocks_.size() << 1) * in_rounded, nelem, (size_t)roundup(nelem));
+                             out.size(), (blocks_.size() << 1) * in_rounded, nelem, (size_t)kernel_input_size<KernelBlock>(nelem));
                 out.resize((blocks_.size() << 1) * in_rounded);
             }
         }
@@ -389,17 +478,17 @@ public:
     }
     template<typename InputType, typename OutputType, typename=std::enable_if_t<!std::is_arithmetic_v<InputType>>>
     void apply(OutputType &out, const InputType &in) const {
-        size_t in_rounded(roundup(in.size()));
+        size_t in_rounded(kernel_input_size<KernelBlock>(in.size()));
         if(out.size() != (blocks_.size() << 1) * in_rounded) {
             if constexpr(blaze::IsView<OutputType>::value) {
                 char buf[2048];
                 std::sprintf(buf, "[%s] Wanted to resize out block from %zu to %zu to match %zu input and %zu rounded up input.\n",
-                                    __PRETTY_FUNCTION__, out.size(), (blocks_.size() << 1) * in_rounded, in.size(), static_cast<size_t>(roundup(in.size())));
+                                    __PRETTY_FUNCTION__, out.size(), (blocks_.size() << 1) * in_rounded, in.size(), static_cast<size_t>(kernel_input_size<KernelBlock>(in.size())));
                 ::std::cerr << buf;
                 throw std::runtime_error(buf);
             } else {
                 std::fprintf(stderr, "Resizing out block from %zu to %zu to match %zu input and %zu rounded up input.\n",
-                             out.size(), (blocks_.size() << 1) * in_rounded, in.size(), (size_t)roundup(in.size()));
+                             out.size(), (blocks_.size() << 1) * in_rounded, in.size(), (size_t)kernel_input_size<KernelBlock>(in.size()));
                 out.resize((blocks_.size() << 1) * in_rounded);
             }
         }
@@ -427,6 +516,8 @@ template<typename FloatType, typename RademType>
 using FastFoodKernelBlock = ff::KernelBlock<FloatType, RademType>;
 template<typename FloatType, typename RademType>
 using SORFKernelBlock = sorf::KernelBlock<FloatType, RademType>;
+template<typename FloatType, typename RademType=PRNRademacher>
+using DCTSORFKernelBlock = sorf::DCTKernelBlock<FloatType, RademType>;
 
 } // namespace kernel
 
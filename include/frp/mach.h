@@ -1,5 +1,6 @@
 #ifndef _GFRP_MACH_H__
 #define _GFRP_MACH_H__
+#include <algorithm>
 #include <cassert>
 #include <string>
 #include <unistd.h>
@@ -7,12 +8,13 @@
 #include <cstdio>
 #include <cstdlib>
 #include <cstddef>
+#include <cstring>
 #include "kspp/ks.h"
 #include "frp/util.h"
 
 namespace frp { namespace mach {
 
-void print_toks(std::vector<ks::string> &strings) {
+inline void print_toks(std::vector<ks::string> &strings) {
     ks::string tmp;
     tmp.sprintf("Num toks: %zu\t", strings.size());
     for(const auto &str: strings) tmp.resize(tmp.size() + str.size());
@@ -47,9 +49,10 @@ struct CacheSizes {
 template<typename SizeType=size_t>
 CacheSizes get_cache_sizes() {
     FILE *fp(popen(CACHE_CMD_STR, "r"));
+    CacheSizes ret;
+    if(fp == nullptr) return ret;
     char buf[1 << 16];
     memset(buf, 0, sizeof(buf));
-    CacheSizes ret;
     SizeType  *ptr;
     char     *line;
     while((line = fgets(buf, sizeof(buf), fp))) {
@@ -65,9 +68,7 @@ CacheSizes get_cache_sizes() {
         } else if(toks[0] == "L3") {
             ptr = &ret[2];
         } else {
-            fclose(fp);
-            fprintf(stderr, "DIE (%s)\n", toks[0].data());
-            exit(1);
+            continue; // Other lines mentioning caches, e.g. "Vulnerability L1tf: ... cache flushes".
         }
 #ifdef __APPLE__
         const auto &endtok(toks.back());
@@ -75,10 +76,14 @@ CacheSizes get_cache_sizes() {
         *ptr = atoi(magtok.data());
         const char sizechar(endtok[0]);
 #else
-        const char *tmp(toks.back().data());
+        // Older lscpu prints "32K" per core; newer prints totals, "384 KiB (8 instances)".
+        size_t numtok(1);
+        while(numtok < toks.size() && !isdigit(toks[numtok][0])) ++numtok;
+        if(numtok == toks.size()) continue;
+        const char *tmp(toks[numtok].data());
         *ptr = atoi(tmp);
         while(isdigit(*tmp)) ++tmp;
-        const char sizechar(*tmp);
+        const char sizechar(*tmp ? *tmp: numtok + 1 < toks.size() ? toks[numtok + 1][0]: 'B');
 #endif
         assert(isalpha(sizechar));
         switch(sizechar) {
@@ -87,9 +92,72 @@ CacheSizes get_cache_sizes() {
             case 'M': case 'm': *ptr <<= 20; break;
             case 'K': case 'k': *ptr <<= 10; break;
         }
+#ifndef __APPLE__
+        for(size_t i(numtok + 1); i < toks.size(); ++i) {
+            if(toks[i][0] == '(' && isdigit(toks[i][1])) {
+                if(const size_t ninstances = atoi(toks[i].data() + 1)) *ptr /= ninstances;
+                break;
+            }
+        }
+#endif
+    }
+
+    pclose(fp);
+    return ret;
+}
+
+// Per-core sizes from /sys/devices/system/cpu/cpu0/cache. Levels not found are 0.
+inline CacheSizes sysfs_cache_sizes() {
+    CacheSizes ret;
+    char buf[64];
+    for(unsigned index(0);; ++index) {
+        auto read_field = [&](const char *field) {
+            char path[128];
+            std::sprintf(path, "/sys/devices/system/cpu/cpu0/cache/index%u/%s", index, field);
+            FILE *fp(std::fopen(path, "r"));
+            if(fp == nullptr) return false;
+            const bool ok(std::fgets(buf, sizeof(buf), fp) != nullptr);
+            std::fclose(fp);
+            return ok;
+        };
+        if(!read_field("level")) break;
+        const int level(std::atoi(buf));
+        if(level < 1 || level > 3 || !read_field("type") || std::strncmp(buf, "Instruction", 11) == 0) continue;
+        if(!read_field("size")) continue;
+        char *end;
+        size_t size(std::strtoull(buf, &end, 10));
+        switch(*end) {
+            case 'G': size <<= 30; break;
+            case 'M': size <<= 20; break;
+            case 'K': size <<= 10; break;
+        }
+        ret[level - 1] = size;
     }
+    return ret;
+}
 
-    fclose(fp);
+// Cache sizes, looked up once per process.
+// sysconf is tried first, then sysfs; lscpu is only run for levels both miss, and conservative defaults fill the rest.
+inline const CacheSizes &cache_sizes() {
+    static const CacheSizes ret([] {
+        CacheSizes cs;
+#ifdef _SC_LEVEL1_DCACHE_SIZE
+        cs.l1 = std::max(0L, sysconf(_SC_LEVEL1_DCACHE_SIZE));
+        cs.l2 = std::max(0L, sysconf(_SC_LEVEL2_CACHE_SIZE));
+        cs.l3 = std::max(0L, sysconf(_SC_LEVEL3_CACHE_SIZE));
+#endif
+        auto fill_missing = [&cs](const CacheSizes &other) {
+            if(!cs.l1) cs.l1 = other.l1;
+            if(!cs.l2) cs.l2 = other.l2;
+            if(!cs.l3) cs.l3 = other.l3;
+        };
+        if(!cs.l1 || !cs.l2 || !cs.l3) fill_missing(sysfs_cache_sizes());
+        if(!cs.l1 || !cs.l2 || !cs.l3) fill_missing(get_cache_sizes());
+        if(!cs.l1) cs.l1 = size_t(32) << 10;
+        if(!cs.l2) cs.l2 = size_t(256) << 10;
+        if(!cs.l3) cs.l3 = size_t(8) << 20;
+        return cs;
+    }());
     return ret;
 }
 
@@ -1,6 +1,35 @@
 #ifndef _GFRP_PARSER_H__
 #define _GFRP_PARSER_H__
+#include <algorithm>
+#include <array>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <string_view>
+#include <thread>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if __AVX2__
+#include <immintrin.h>
+#endif
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 #include "frp/util.h"
+#include "frp/fastfloat.h"
+#if !defined(FRP_NO_BZIP2) && __has_include(<bzlib.h>)
+#  include <bzlib.h>
+#  define FRP_HAVE_BZIP2 1
+#endif
+#if !defined(FRP_NO_ZSTD) && __has_include(<zstd.h>)
+#  include <zstd.h>
+#  define FRP_HAVE_ZSTD 1
+#endif
 
 namespace frp {
 
@@ -34,9 +63,6 @@ struct IOTypes<gzFile> {
 static const std::string zlibsuf  = ".gz";
 static const std::string bzip2suf = ".bz2";
 static const std::string zstdsuf  = ".zst";
-static const std::string zlibcmd  = "gzip -dc ";
-static const std::string bzip2cmd = "bzip2 -dc ";
-static const std::string zstdcmd  = "ztd -dc ";
 
 bool ends_with(const std::string &pat, const std::string &ref) {
     return std::equal(std::rbegin(pat), std::rend(pat), std::rbegin(ref));
@@ -57,34 +83,533 @@ CType infer_ctype(const std::string &path) {
     return UNCOMPRESSED;
 }
 
+// Compression format from the first bytes of a file, or UNKNOWN if none matches.
+inline CType sniff_ctype(const void *data, size_t n) {
+    const unsigned char *p(static_cast<const unsigned char *>(data));
+    if(n >= 2 && p[0] == 0x1f && p[1] == 0x8b)                               return ZLIB;
+    if(n >= 4 && p[0] == 0x28 && p[1] == 0xb5 && p[2] == 0x2f && p[3] == 0xfd) return ZSTD;
+    if(n >= 3 && p[0] == 'B' && p[1] == 'Z' && p[2] == 'h')                   return BZIP2;
+    return UNKNOWN;
+}
+
+static constexpr size_t DEFAULT_BUFSZ = size_t(1) << 20;
+
+// Byte source for LineReader. read returns 0 only at the end of the input and throws on errors.
+class InputStream {
+public:
+    virtual size_t read(char *buf, size_t len) = 0;
+    virtual ~InputStream() {}
+};
+
+// A file, or stdin for "-". Bytes peeked for format detection are returned by the first reads.
+class FileStream: public InputStream {
+    FILE *fp_;
+    std::string path_;
+    unsigned char head_[4];
+    size_t nhead_, headpos_;
+public:
+    explicit FileStream(const std::string &path):
+        fp_(path == "-" ? stdin: std::fopen(path.data(), "rb")), path_(path), nhead_(0), headpos_(0)
+    {
+        if(fp_ == nullptr) throw std::runtime_error(ks::sprintf("Could not open file at %s", path.data()).data());
+    }
+    ~FileStream() {if(fp_ != stdin) std::fclose(fp_);}
+    // Format by magic bytes, falling back to the path's suffix.
+    CType detect() {
+        nhead_ = std::fread(head_, 1, sizeof(head_), fp_);
+        const CType ret(sniff_ctype(head_, nhead_));
+        return ret != UNKNOWN ? ret: infer_ctype(path_);
+    }
+    size_t read(char *buf, size_t len) override {
+        size_t ret(0);
+        for(; headpos_ < nhead_ && ret < len; ++ret) buf[ret] = head_[headpos_++];
+        ret += std::fread(buf + ret, 1, len - ret, fp_);
+        if(ret < len && std::ferror(fp_)) throw std::runtime_error(ks::sprintf("Error reading %s", path_.data()).data());
+        return ret;
+    }
+    const std::string &path() const {return path_;}
+};
+
+// gzip or zlib data, including concatenated gzip members. Trailing garbage after a complete member is ignored.
+class GzipStream: public InputStream {
+    std::unique_ptr<FileStream> src_;
+    std::vector<char> in_;
+    z_stream zs_;
+    bool midstream_;
+    bool ended_; // A member just ended; what follows is either another member or trailing garbage.
+    bool done_;
+
+    // Whether the remaining input starts another gzip member (1f 8b), reading ahead as needed.
+    // Anything else after a complete member, such as tar-style zero padding, is ignored with a warning, as gzip -d does.
+    bool next_member() {
+        while(zs_.avail_in < 2) {
+            if(zs_.avail_in) std::memmove(in_.data(), zs_.next_in, zs_.avail_in);
+            zs_.next_in = reinterpret_cast<Bytef *>(in_.data());
+            const size_t n(src_->read(in_.data() + zs_.avail_in, in_.size() - zs_.avail_in));
+            if(n == 0) break;
+            zs_.avail_in += n;
+        }
+        if(zs_.avail_in == 0) return false;
+        if(zs_.avail_in >= 2 && zs_.next_in[0] == 0x1f && zs_.next_in[1] == 0x8b) return true;
+        std::fprintf(stderr, "Warning: ignoring trailing garbage after gzip data in %s\n", src_->path().data());
+        zs_.avail_in = 0;
+        return false;
+    }
+public:
+    explicit GzipStream(std::unique_ptr<FileStream> src): src_(std::move(src)), in_(DEFAULT_BUFSZ), zs_{}, midstream_(false), ended_(false), done_(false) {
+        if(inflateInit2(&zs_, 15 + 32) != Z_OK) throw std::runtime_error("Could not initialize zlib.");
+    }
+    ~GzipStream() {inflateEnd(&zs_);}
+    size_t read(char *buf, size_t len) override {
+        zs_.next_out = reinterpret_cast<Bytef *>(buf);
+        zs_.avail_out = len;
+        while(zs_.avail_out && !done_) {
+            if(ended_) {
+                if(!next_member()) {
+                    done_ = true;
+                    break;
+                }
+                ended_ = false;
+            }
+            if(zs_.avail_in == 0) {
+                const size_t n(src_->read(in_.data(), in_.size()));
+                if(n == 0) {
+                    if(midstream_) throw std::runtime_error(ks::sprintf("Truncated gzip input %s", src_->path().data()).data());
+                    break;
+                }
+                zs_.next_in = reinterpret_cast<Bytef *>(in_.data());
+                zs_.avail_in = n;
+            }
+            midstream_ = true;
+            const int rc(inflate(&zs_, Z_NO_FLUSH));
+            if(rc == Z_STREAM_END) {
+                inflateReset(&zs_);
+                midstream_ = false;
+                ended_ = true;
+            } else if(rc != Z_OK) {
+                throw std::runtime_error(ks::sprintf("zlib error %d reading %s: %s", rc, src_->path().data(), zs_.msg ? zs_.msg: "").data());
+            }
+        }
+        return len - zs_.avail_out;
+    }
+};
+
+#ifdef FRP_HAVE_BZIP2
+// bzip2 data, including concatenated streams.
+class Bzip2Stream: public InputStream {
+    std::unique_ptr<FileStream> src_;
+    std::vector<char> in_;
+    bz_stream bs_;
+    bool midstream_;
+public:
+    explicit Bzip2Stream(std::unique_ptr<FileStream> src): src_(std::move(src)), in_(DEFAULT_BUFSZ), bs_{}, midstream_(false) {
+        if(BZ2_bzDecompressInit(&bs_, 0, 0) != BZ_OK) throw std::runtime_error("Could not initialize bzip2.");
+    }
+    ~Bzip2Stream() {BZ2_bzDecompressEnd(&bs_);}
+    size_t read(char *buf, size_t len) override {
+        bs_.next_out = buf;
+        bs_.avail_out = len;
+        while(bs_.avail_out) {
+            if(bs_.avail_in == 0) {
+                const size_t n(src_->read(in_.data(), in_.size()));
+                if(n == 0) {
+                    if(midstream_) throw std::runtime_error(ks::sprintf("Truncated bzip2 input %s", src_->path().data()).data());
+                    break;
+                }
+                bs_.next_in = in_.data();
+                bs_.avail_in = n;
+            }
+            midstream_ = true;
+            const int rc(BZ2_bzDecompress(&bs_));
+            if(rc == BZ_STREAM_END) {
+                // Restart for a following stream, keeping unconsumed input.
+                char *const next_in(bs_.next_in), *const next_out(bs_.next_out);
+                const unsigned avail_in(bs_.avail_in), avail_out(bs_.avail_out);
+                BZ2_bzDecompressEnd(&bs_);
+                bs_ = bz_stream{};
+                if(BZ2_bzDecompressInit(&bs_, 0, 0) != BZ_OK) throw std::runtime_error("Could not initialize bzip2.");
+                bs_.next_in = next_in, bs_.avail_in = avail_in, bs_.next_out = next_out, bs_.avail_out = avail_out;
+                midstream_ = false;
+            } else if(rc != BZ_OK) {
+                throw std::runtime_error(ks::sprintf("bzip2 error %d reading %s", rc, src_->path().data()).data());
+            }
+        }
+        return len - bs_.avail_out;
+    }
+};
+#endif
+
+#ifdef FRP_HAVE_ZSTD
+// zstd data; ZSTD_decompressStream handles concatenated frames itself.
+class ZstdStream: public InputStream {
+    std::unique_ptr<FileStream> src_;
+    std::vector<char> in_;
+    ZSTD_DStream *ds_;
+    ZSTD_inBuffer zin_;
+    size_t hint_; // Nonzero while a frame is incomplete.
+public:
+    explicit ZstdStream(std::unique_ptr<FileStream> src):
+        src_(std::move(src)), in_(std::max(ZSTD_DStreamInSize(), DEFAULT_BUFSZ)), ds_(ZSTD_createDStream()), zin_{in_.data(), 0, 0}, hint_(0)
+    {
+        if(ds_ == nullptr || ZSTD_isError(ZSTD_initDStream(ds_))) throw std::runtime_error("Could not initialize zstd.");
+    }
+    ~ZstdStream() {ZSTD_freeDStream(ds_);}
+    size_t read(char *buf, size_t len) override {
+        ZSTD_outBuffer out{buf, len, 0};
+        while(out.pos < out.size) {
+            if(zin_.pos == zin_.size) {
+                const size_t n(src_->read(in_.data(), in_.size()));
+                if(n == 0) {
+                    if(hint_ == 0) break;
+                    // All input is consumed, but decoded bytes may still be buffered in the stream: flush them.
+                    // The input is only truncated if a flush makes no progress.
+                    ZSTD_inBuffer empty{nullptr, 0, 0};
+                    const size_t pos(out.pos);
+                    hint_ = ZSTD_decompressStream(ds_, &out, &empty);
+                    if(ZSTD_isError(hint_))
+                        throw std::runtime_error(ks::sprintf("zstd error reading %s: %s", src_->path().data(), ZSTD_getErrorName(hint_)).data());
+                    if(out.pos == pos) {
+                        if(hint_) throw std::runtime_error(ks::sprintf("Truncated zstd input %s", src_->path().data()).data());
+                        break;
+                    }
+                    continue;
+                }
+                zin_ = ZSTD_inBuffer{in_.data(), n, 0};
+            }
+            hint_ = ZSTD_decompressStream(ds_, &out, &zin_);
+            if(ZSTD_isError(hint_))
+                throw std::runtime_error(ks::sprintf("zstd error reading %s: %s", src_->path().data(), ZSTD_getErrorName(hint_)).data());
+        }
+        return out.pos;
+    }
+};
+#endif
+
+// Runs another stream on a background thread, DEPTH blocks ahead of the reader, so decompression overlaps parsing.
+class ThreadedStream: public InputStream {
+    static constexpr size_t DEPTH = 4;
+    std::unique_ptr<InputStream> src_;
+    std::deque<std::vector<char>> full_;
+    std::vector<char> cur_;
+    size_t curpos_;
+    bool done_, stop_;
+    std::exception_ptr err_;
+    std::mutex m_;
+    std::condition_variable cv_;
+    std::thread worker_;
+
+    void produce() {
+        try {
+            for(;;) {
+                std::vector<char> block(DEFAULT_BUFSZ);
+                block.resize(src_->read(block.data(), block.size()));
+                std::unique_lock<std::mutex> lock(m_);
+                cv_.wait(lock, [this]() {return full_.size() < DEPTH || stop_;});
+                if(stop_) return;
+                if(block.empty()) break;
+                full_.emplace_back(std::move(block));
+                cv_.notify_all();
+            }
+        } catch(...) {
+            std::lock_guard<std::mutex> lock(m_);
+            err_ = std::current_exception();
+        }
+        std::lock_guard<std::mutex> lock(m_);
+        done_ = true;
+        cv_.notify_all();
+    }
+public:
+    explicit ThreadedStream(std::unique_ptr<InputStream> src):
+        src_(std::move(src)), curpos_(0), done_(false), stop_(false), worker_([this]() {produce();}) {}
+    ~ThreadedStream() {
+        {
+            std::lock_guard<std::mutex> lock(m_);
+            stop_ = true;
+        }
+        cv_.notify_all();
+        worker_.join();
+    }
+    size_t read(char *buf, size_t len) override {
+        size_t ret(0);
+        while(ret < len) {
+            if(curpos_ == cur_.size()) {
+                std::unique_lock<std::mutex> lock(m_);
+                cv_.wait(lock, [this]() {return !full_.empty() || done_;});
+                if(full_.empty()) {
+                    if(err_) std::rethrow_exception(err_);
+                    break;
+                }
+                cur_ = std::move(full_.front());
+                full_.pop_front();
+                curpos_ = 0;
+                cv_.notify_all();
+            }
+            const size_t n(std::min(len - ret, cur_.size() - curpos_));
+            std::memcpy(buf + ret, cur_.data() + curpos_, n);
+            ret += n, curpos_ += n;
+        }
+        return ret;
+    }
+};
+
+// Opens path ("-" for stdin), decompressing in-process. UNKNOWN detects the format from magic bytes, then the suffix.
+inline std::unique_ptr<InputStream> open_stream(const std::string &path, CType ctype=UNKNOWN, bool threaded=false) {
+    auto file(std::make_unique<FileStream>(path));
+    const CType detected(file->detect());
+    std::unique_ptr<InputStream> ret;
+    switch(ctype == UNKNOWN ? detected: ctype) {
+        case UNCOMPRESSED: ret = std::move(file); break;
+        case ZLIB:         ret = std::make_unique<GzipStream>(std::move(file)); break;
+#ifdef FRP_HAVE_BZIP2
+        case BZIP2:        ret = std::make_unique<Bzip2Stream>(std::move(file)); break;
+#endif
+#ifdef FRP_HAVE_ZSTD
+        case ZSTD:         ret = std::make_unique<ZstdStream>(std::move(file)); break;
+#endif
+        default: throw std::runtime_error(ks::sprintf("Unsupported compression type %d for %s", int(ctype == UNKNOWN ? detected: ctype), path.data()).data());
+    }
+    if(threaded) ret = std::make_unique<ThreadedStream>(std::move(ret));
+    return ret;
+}
+
+// First occurrence of delim in [p, end), or end.
+// The AVX2 path reads whole aligned 32-byte blocks, which never cross a page,
+// so it may touch bytes just outside [p, end) in the same block but never faults.
+inline const char *find_delim(const char *p, const char *end, char delim) {
+#if __AVX2__
+    if(p >= end) return end;
+    const __m256i d(_mm256_set1_epi8(delim));
+    const size_t lead(reinterpret_cast<uintptr_t>(p) & 31);
+    const char *block(p - lead);
+    uint32_t mask(static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_load_si256(reinterpret_cast<const __m256i *>(block)), d))) >> lead);
+    if(mask) return std::min(p + __builtin_ctz(mask), end);
+    for(block += 32; block + 64 <= end; block += 64) {
+        const __m256i lo(_mm256_cmpeq_epi8(_mm256_load_si256(reinterpret_cast<const __m256i *>(block)), d)),
+                      hi(_mm256_cmpeq_epi8(_mm256_load_si256(reinterpret_cast<const __m256i *>(block + 32)), d));
+        if(_mm256_testz_si256(_mm256_or_si256(lo, hi), _mm256_or_si256(lo, hi))) continue;
+        if((mask = _mm256_movemask_epi8(lo))) return block + __builtin_ctz(mask);
+        return block + 32 + __builtin_ctz(static_cast<uint32_t>(_mm256_movemask_epi8(hi)));
+    }
+    for(; block < end; block += 32)
+        if((mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_load_si256(reinterpret_cast<const __m256i *>(block)), d))))
+            return std::min(block + __builtin_ctz(mask), end);
+    return end;
+#else
+    const void *ret(std::memchr(p, delim, end - p));
+    return ret ? static_cast<const char *>(ret): end;
+#endif
+}
+
+static constexpr size_t MIN_CHUNK_BYTES  = size_t(1) << 18; // Smallest piece of text worth a parallel task.
+static constexpr size_t LOAD_BLOCK_BYTES = size_t(1) << 26; // Decompressed text parsed per parallel round when not mapped.
+
+/*
+ * Offsets splitting [begin, end) into at most nchunks pieces of whole lines:
+ * piece c is [begin + ret[c], begin + ret[c + 1]), ret.front() == 0 and ret.back() == end - begin.
+ * Each boundary is moved forward to just after a delimiter, so pieces may be empty.
+ */
+inline std::vector<size_t> line_chunks(const char *begin, const char *end, size_t nchunks, char delim='\n') {
+    const size_t n(end - begin);
+    nchunks = std::max(size_t(1), std::min(nchunks, n / MIN_CHUNK_BYTES));
+    std::vector<size_t> ret(nchunks + 1);
+    for(size_t c = 1; c < nchunks; ++c) {
+        const char *const guess(begin + std::max(ret[c - 1], n * c / nchunks));
+        const char *const found(find_delim(guess, end, delim));
+        ret[c] = found + (found != end) - begin;
+    }
+    ret[nchunks] = n;
+    return ret;
+}
+inline size_t default_nchunks() {
+#ifdef _OPENMP
+    return 4 * omp_get_max_threads();
+#else
+    return 1;
+#endif
+}
+
+// Calls func(line_begin, line_end) for each line of [begin, end), excluding its delimiter.
+template<typename Func>
+inline void for_each_line(const char *begin, const char *end, char delim, const Func &func) {
+    while(begin < end) {
+        const char *const found(find_delim(begin, end, delim));
+        func(begin, found);
+        begin = found + 1;
+    }
+}
+
 } // namespace io
 
 #define USE_FP(attr) static constexpr auto attr = io::IOTypes<FPType>::attr
 
+/*
+ * Rows in compressed sparse row form, as read from libsvm text: row i has entries
+ * (indices[k], data[k]) for k in [indptr[i], indptr[i + 1]), with increasing column indices, and label labels[i].
+ * Column indices are zero-based; libsvm's one-based indices are shifted down by one.
+ */
+template<typename FloatType=FLOAT_TYPE, typename IndexType=uint32_t>
+struct CSRMatrix {
+    std::vector<size_t>    indptr{0};
+    std::vector<IndexType> indices;
+    std::vector<FloatType> data;
+    std::vector<FloatType> labels;
+    size_t ncols = 0;
+
+    size_t rows()    const {return indptr.size() - 1;}
+    size_t columns() const {return ncols;}
+    size_t nnz()     const {return indptr.back();}
+    void clear() {
+        indptr.assign(1, 0);
+        indices.clear();
+        data.clear();
+        labels.clear();
+        ncols = 0;
+    }
+    template<bool SO=blaze::rowMajor>
+    blaze::CompressedMatrix<FloatType, SO> to_compressed() const {
+        blaze::CompressedMatrix<FloatType, SO> ret(rows(), ncols);
+        if constexpr(SO == blaze::rowMajor) {
+            ret.reserve(nnz());
+            for(size_t i(0); i < rows(); ++i) {
+                for(size_t k(indptr[i]); k < indptr[i + 1]; ++k) ret.append(i, indices[k], data[k]);
+                ret.finalize(i);
+            }
+        } else {
+            blaze::CompressedMatrix<FloatType, blaze::rowMajor> tmp(to_compressed<blaze::rowMajor>());
+            ret = tmp;
+        }
+        return ret;
+    }
+};
+
 class LineReader {
-    FILE         *fp_;
     std::string path_;
-    io::CType  ctype_;
+    io::CType  ctype_;    // UNKNOWN: detect from magic bytes, then the suffix.
     char       delim_;
-    size_t     bufsz_;
+    size_t     bufsz_;    // Capacity of data_.
     ssize_t      len_;
-    char       *data_;
+    char       *data_;    // Decompressed bytes not yet returned, from begin_ to end_.
     const std::string comment_lines_;
+    bool    use_mmap_;
+    bool    threaded_;
+    char       *map_;     // Uncompressed regular files are mapped rather than read.
+    size_t    mapsz_;     // File size.
+    size_t reserved_;     // Size of the mapping, which ends in at least one zero byte.
+    char       *pos_;     // Start of the next line in the mapping.
+    char      *line_;     // Current line: into the mapping, or data_.
+    std::unique_ptr<io::InputStream> in_;
+    size_t begin_, end_, scanned_; // scanned_: bytes after begin_ known not to hold a delimiter.
+    bool eof_;
+    char *saved_at_;      // Byte after the current line, replaced by a NUL while the line is current.
+    char  saved_;
+    std::array<bool, 256> is_comment_;
 
     /*
       Reads through a file line by line just once. Will add more functionality later.
+      Uncompressed regular files are memory-mapped, and lines are views into the mapping:
+      they are not NUL-terminated, but the file as a whole is, so C string functions stop at its end.
+      Other inputs, including stdin ("-") and gzip, bzip2 and zstd files, are decompressed in-process
+      into a buffer, optionally on a separate thread, and lines there are NUL-terminated.
      */
+    bool map_file() {
+        if(ctype_ > io::UNCOMPRESSED || (ctype_ == io::UNKNOWN && io::infer_ctype(path_) != io::UNCOMPRESSED)) return false;
+        const int fd(::open(path_.data(), O_RDONLY));
+        if(fd < 0) return false;
+        struct stat st;
+        if(::fstat(fd, &st) || !S_ISREG(st.st_mode)) {
+            ::close(fd);
+            return false;
+        }
+        const size_t page(::sysconf(_SC_PAGESIZE));
+        mapsz_ = st.st_size;
+        reserved_ = (mapsz_ / page + 1) * page;
+        // Reserve zeroed memory with room past the end, then map the file over its start.
+        void *base(::mmap(nullptr, reserved_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+        if(base != MAP_FAILED && mapsz_ &&
+           ::mmap(base, mapsz_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+            ::munmap(base, reserved_);
+            base = MAP_FAILED;
+        }
+        ::close(fd);
+        if(base == MAP_FAILED) return false;
+        if(ctype_ == io::UNKNOWN && io::sniff_ctype(base, mapsz_) != io::UNKNOWN) { // Compressed, whatever its name.
+            ::munmap(base, reserved_);
+            return false;
+        }
+        if(mapsz_) ::madvise(base, mapsz_, MADV_SEQUENTIAL);
+        map_ = static_cast<char *>(base);
+        return true;
+    }
+    // Next line from the stream, reading more whenever the buffer holds no complete line.
+    void next_buffered_line() {
+        for(;;) {
+            char *const found(const_cast<char *>(io::find_delim(data_ + begin_ + scanned_, data_ + end_, delim_)));
+            if(found != data_ + end_ || (eof_ && begin_ < end_)) {
+                line_ = data_ + begin_;
+                len_ = found + (found != data_ + end_) - line_;
+                begin_ += len_;
+                scanned_ = 0;
+                saved_at_ = line_ + len_;
+                saved_ = *saved_at_;
+                *saved_at_ = '\0';
+                return;
+            }
+            if(eof_) {
+                len_ = -1;
+                return;
+            }
+            scanned_ = end_ - begin_;
+            if(begin_) {
+                std::memmove(data_, data_ + begin_, end_ - begin_);
+                end_ -= begin_;
+                begin_ = 0;
+            }
+            if(end_ + 1 >= bufsz_ / 2) { // Keep reads large: grow once a partial line fills half the buffer.
+                char *const tmp(static_cast<char *>(std::realloc(data_, bufsz_ * 2)));
+                if(tmp == nullptr) throw std::bad_alloc();
+                data_ = tmp;
+                bufsz_ *= 2;
+            }
+            const size_t n(in_->read(data_ + end_, bufsz_ - 1 - end_)); // One byte spare for the NUL after the last line.
+            eof_ = n == 0;
+            end_ += n;
+        }
+    }
+    void next_line() {
+        do {
+            if(map_) {
+                char *const end(map_ + mapsz_);
+                if(pos_ >= end) {
+                    len_ = -1;
+                    return;
+                }
+                char *const found(const_cast<char *>(io::find_delim(pos_, end, delim_)));
+                line_ = pos_;
+                pos_ = found + (found != end); // Like getdelim, a line includes its delimiter.
+                len_ = pos_ - line_;
+            } else {
+                if(saved_at_) *saved_at_ = saved_, saved_at_ = nullptr;
+                next_buffered_line();
+            }
+        } while(len_ != -1 && is_comment_[static_cast<uint8_t>(line_[0])]);
+    }
 public:
     LineReader(const char *path,
-               char delim='\n', size_t bufsz=0, io::CType ctype=io::UNKNOWN, std::string comment_lines="#"):
-        fp_(nullptr), path_(path), ctype_(ctype >= 0 ? ctype: io::infer_ctype(path_)),
-        delim_(delim), bufsz_(bufsz),
-        len_(0), data_(bufsz_ ? (char *)std::malloc(bufsz_): nullptr),
-        comment_lines_(std::move(comment_lines))
+               char delim='\n', size_t bufsz=0, io::CType ctype=io::UNKNOWN, std::string comment_lines="#",
+               bool use_mmap=true, bool threaded=false):
+        path_(path), ctype_(ctype),
+        delim_(delim), bufsz_(bufsz ? std::max(bufsz, size_t(64)): io::DEFAULT_BUFSZ),
+        len_(0), data_(static_cast<char *>(std::malloc(bufsz_))),
+        comment_lines_(std::move(comment_lines)),
+        use_mmap_(use_mmap), threaded_(threaded), map_(nullptr), mapsz_(0), reserved_(0), pos_(nullptr), line_(data_),
+        begin_(0), end_(0), scanned_(0), eof_(false), saved_at_(nullptr), saved_(0)
     {
+        if(data_ == nullptr) throw std::bad_alloc();
+        is_comment_.fill(false);
+        for(const char c: comment_lines_) is_comment_[static_cast<uint8_t>(c)] = true;
     }
     ~LineReader() {
-        if(fp_) fclose(fp_);
+        if(map_) ::munmap(map_, reserved_);
         std::free(data_);
     }
     class LineIterator {
@@ -96,10 +621,7 @@ public:
             return *this;
         }
         LineIterator &operator++() {
-            ref_.len_ = getdelim(&ref_.data_, &ref_.bufsz_, ref_.delim_, ref_.fp_);
-            if(good())
-                if(std::find(ref_.comment_lines_.begin(), ref_.comment_lines_.end(), ref_.data_[0]) != ref_.comment_lines_.end())
-                    return this->operator++();
+            ref_.next_line();
             return *this;
         }
         using uivec_t = std::vector<unsigned>;
@@ -107,6 +629,7 @@ public:
         ssize_t len() const {return ref_.len();}
         char *data() {return ref_.data();}
         const char *data() const {return ref_.data();}
+        std::string_view view() const {return ref_.view();}
         bool operator!=([[maybe_unused]] const LineIterator &other) const {return good();}
         bool operator< ([[maybe_unused]] const LineIterator &other) const {return good();}
         char &operator[](size_t index) {return data()[index];}
@@ -123,13 +646,16 @@ public:
                 std::fprintf(stderr, "Warning: ret is now %zu in size.\n", ret.size());
                 //throw std::runtime_error(ks::sprintf("Wrong sizes. Number of fields: %zu. Size of array: %zu\n", offsets.size(), ret.size()).data());
             }
+            const char *const line_end(data() + len());
             size_t i;
 #ifdef USE_OPENMP
 #pragma message("use openmp")
             #pragma omp parallel for schedule(dynamic, 8192)
 #endif
             for(i = 0; i < std::min(ret.size(), offsets.size()); ++i) {
-                ret[i] = std::atof(data() + offsets[i]);
+                FloatType v;
+                fastfloat::parse(data() + offsets[i], line_end, v);
+                ret[i] = v;
             }
             if constexpr(!blaze::IsSparseVector<VectorType<FloatType, Orientation>>::value) {
                 std::memset(&ret[i], 0, (ret.size() - i) * sizeof(FloatType)); // Zero the last elements in array.
@@ -139,11 +665,13 @@ public:
         void set(VectorType<FloatType, Orientation> &ret, const int delim=',') {
             if constexpr(blaze::IsSparseVector<VectorType<FloatType, Orientation>>::value)
                 blaze::reset(ret);
-            char *p(data()), *line_end(p + len());
+            const char *p(data()), *const line_end(p + len());
             size_t i(0), e(ret.size());
-            while(p < line_end) {
-                ret[i++] = std::atof(p);
-                if(((p = std::strchr(p, delim)) == nullptr) | (i == e)) break;
+            while(p < line_end && i < e) {
+                FloatType v;
+                p = fastfloat::parse(p, line_end, v);
+                ret[i++] = v;
+                if((p = static_cast<const char *>(std::memchr(p, delim, line_end - p))) == nullptr) break;
                 ++p;
             }
             if constexpr(!blaze::IsSparseVector<VectorType<FloatType, Orientation>>::value) {
@@ -152,36 +680,322 @@ public:
         }
         template<template <typename, bool> typename VectorType, typename FloatType, bool Orientation>
         int sparse_set(VectorType<FloatType, Orientation> &ret, const int delim=' ') {
-            char *p(data()), *line_end(p + len());
-            const int label(std::atoi(p));
+            const char *p(data()), *const line_end(p + len());
+            int label;
+            p = fastfloat::parse_integer(p, line_end, label);
             blaze::reset(ret);
-            if((p = std::strchr(p, ' ')) == nullptr) return label;
+            if((p = static_cast<const char *>(std::memchr(p, ' ', line_end - p))) == nullptr) return label;
             ++p;
             while(p < line_end) {
-                ret[std::atoi(p) - 1] = std::atof(std::strchr(p, ':') + 1);
-                if((p = std::strchr(p, delim)) == nullptr) break;
+                size_t index;
+                const char *const colon(fastfloat::parse_integer(p, line_end, index));
+                if(colon == line_end || *colon != ':' || index == 0) break;
+                FloatType v;
+                p = fastfloat::parse(colon + 1, line_end, v);
+                ret[index - 1] = v;
+                if((p = static_cast<const char *>(std::memchr(p, delim, line_end - p))) == nullptr) break;
                 ++p;
             }
             return label;
         }
     };
-    LineIterator begin() {
-        using namespace io;
-        if(fp_) {
-            fclose(fp_);
-            std::fprintf(stderr, "Closing!\n");
+    /*
+     * Calls func(begin, end) on consecutive pieces of the input of about blocksz bytes, each a whole number of lines,
+     * which together cover it. A mapped file is sliced in place; other inputs are decompressed into a buffer.
+     * Independent of line iteration, which it does not disturb.
+     */
+    template<typename Func>
+    void for_each_block(const Func &func, size_t blocksz=io::LOAD_BLOCK_BYTES) {
+        if(use_mmap_ && (map_ || map_file())) {
+            const char *const end(map_ + mapsz_);
+            for(const char *p(map_); p < end;) {
+                const char *const found(io::find_delim(p + std::min(std::max(blocksz, size_t(1)), size_t(end - p)) - 1, end, delim_));
+                const char *const next(found + (found != end));
+                func(p, next);
+                p = next;
+            }
+            return;
+        }
+        auto in(io::open_stream(path_, ctype_, threaded_));
+        size_t cap(std::max(blocksz, size_t(64))), have(0);
+        std::unique_ptr<char[]> buf(new char[cap]); // Uninitialized: zeroing a large block costs more than parsing a small input.
+        for(bool eof(false); !eof;) {
+            while(have < cap) {
+                const size_t n(in->read(buf.get() + have, cap - have));
+                if(n == 0) {
+                    eof = true;
+                    break;
+                }
+                have += n;
+            }
+            const char *last(buf.get() + have);
+            if(!eof) {
+                const void *const found(::memrchr(buf.get(), delim_, have));
+                if(found == nullptr) { // A line longer than the block: grow and keep reading.
+                    std::unique_ptr<char[]> tmp(new char[cap * 2]);
+                    std::memcpy(tmp.get(), buf.get(), have);
+                    buf = std::move(tmp);
+                    cap *= 2;
+                    continue;
+                }
+                last = static_cast<const char *>(found) + 1;
+            }
+            func(static_cast<const char *>(buf.get()), last);
+            have -= last - buf.get();
+            std::memmove(buf.get(), last, have);
+        }
+    }
+    // Whether [begin, end), a line without its delimiter, holds data: not blank and not a comment.
+    bool is_data_line(const char *begin, const char *end) const {
+        return begin < end && *begin != '\r' && !is_comment_[static_cast<uint8_t>(*begin)];
+    }
+    /*
+     * Appends the data lines of [begin, end) to ret as rows, in parallel, and returns how many there were.
+     * The text is split into newline-aligned chunks; a first pass counts rows and fields per chunk,
+     * a prefix sum assigns each chunk its first row, and a second pass parses chunks straight into their rows,
+     * so rows keep file order. With ncols == 0 the matrix widens to the longest row; otherwise rows are cut to ncols.
+     * Short rows are zero-filled.
+     */
+    template<typename MatrixType>
+    size_t append_dense(const char *begin, const char *end, MatrixType &ret, const int delim=',', size_t ncols=0) {
+        static_assert(blaze::IsDenseMatrix<MatrixType>::value, "append_dense fills dense matrices.");
+        using FloatType = typename MatrixType::ElementType;
+        const std::vector<size_t> bounds(io::line_chunks(begin, end, io::default_nchunks(), delim_));
+        const int64_t nchunks(bounds.size() - 1);
+        std::vector<size_t> rows(nchunks + 1), cols(nchunks);
+        #pragma omp parallel for schedule(dynamic) if(nchunks > 1)
+        for(int64_t c = 0; c < nchunks; ++c) {
+            io::for_each_line(begin + bounds[c], begin + bounds[c + 1], delim_, [&](const char *lb, const char *le) {
+                if(!is_data_line(lb, le)) return;
+                ++rows[c + 1];
+                if(ncols == 0) cols[c] = std::max(cols[c], size_t(1 + std::count(lb, le, static_cast<char>(delim))));
+            });
         }
-        std::fprintf(stderr, "Opening!\n");
-        switch(ctype_) {
-            case UNCOMPRESSED: fp_ = fopen(path_.data(), "r"); break;
-            case ZLIB:         fp_ = popen((zlibcmd  + path_).data(), "r"); break;
-            case BZIP2:        fp_ = popen((bzip2cmd + path_).data(), "r"); break;
-            case ZSTD:         fp_ = popen((zstdcmd  + path_).data(), "r"); break;
-            default:           throw std::runtime_error("Unexpected ctype code: " + std::to_string((int)ctype_));
+        std::partial_sum(rows.begin(), rows.end(), rows.begin());
+        const size_t nrows(ret.rows()), oldcols(ret.columns());
+        if(ncols == 0) ncols = std::max(oldcols, *std::max_element(cols.begin(), cols.end()));
+        ret.resize(nrows + rows[nchunks], ncols, true);
+        if(ncols > oldcols && nrows) blaze::reset(submatrix(ret, 0, oldcols, nrows, ncols - oldcols));
+        #pragma omp parallel for schedule(dynamic) if(nchunks > 1)
+        for(int64_t c = 0; c < nchunks; ++c) {
+            size_t row(nrows + rows[c]);
+            io::for_each_line(begin + bounds[c], begin + bounds[c + 1], delim_, [&](const char *lb, const char *le) {
+                if(!is_data_line(lb, le)) return;
+                size_t j(0);
+                for(const char *p(lb); j < ncols;) {
+                    FloatType v;
+                    p = fastfloat::parse(p, le, v);
+                    ret(row, j++) = v;
+                    if((p = static_cast<const char *>(std::memchr(p, delim, le - p))) == nullptr) break;
+                    ++p;
+                }
+                for(; j < ncols; ++j) ret(row, j) = 0;
+                ++row;
+            });
+        }
+        return rows[nchunks];
+    }
+    // Reads every data line of the input as a row of ret. Returns the number of rows.
+    template<typename MatrixType>
+    size_t load_dense(MatrixType &ret, const int delim=',', size_t ncols=0) {
+        ret.resize(0, 0, false);
+        for_each_block([&](const char *begin, const char *end) {append_dense(begin, end, ret, delim, ncols);});
+        return ret.rows();
+    }
+    // Streams the input as successive batches of rows (ncols columns each; 0 for the longest row in the batch),
+    // calling func(batch) on each, so inputs larger than memory can be parsed in parallel and consumed in order.
+    template<typename MatrixType, typename Func>
+    void for_each_dense_batch(MatrixType &batch, const Func &func, const int delim=',', size_t ncols=0, size_t blocksz=io::LOAD_BLOCK_BYTES) {
+        for_each_block([&](const char *begin, const char *end) {
+            batch.resize(0, ncols, false);
+            if(append_dense(begin, end, batch, delim, ncols)) func(batch);
+        }, blocksz);
+    }
+    /*
+     * Reads the libsvm lines of the input ("label index:value index:value ...") into ret, in parallel chunks.
+     * One pass (exact == false) parses each chunk into its own arrays and copies them into place.
+     * Two passes (exact == true) first count rows and entries per chunk over the whole input, size ret exactly,
+     * then parse every chunk straight into place: no copies and no slack, at the cost of reading the input twice.
+     * Rows keep file order; entries out of column order within a row are sorted.
+     * Throws if an entry is malformed, has index 0 or repeats a column within its row. Returns the number of rows.
+     */
+    template<typename FloatType, typename IndexType>
+    size_t load_libsvm(CSRMatrix<FloatType, IndexType> &ret, bool exact=false, size_t blocksz=io::LOAD_BLOCK_BYTES) {
+        struct Chunk {
+            std::vector<size_t>    indptr; // Row ends, relative to the chunk.
+            std::vector<IndexType> indices;
+            std::vector<FloatType> data, labels;
+            size_t nrows = 0, nnz = 0, maxcol = 0;
+            bool bad = false;
+            bool changed = false; // exact: the chunk no longer matches the first pass's counts.
+        };
+        // Parses one line into (indices, data), sorting if needed; returns the label, or flags the chunk.
+        auto parse_line = [](const char *lb, const char *le, IndexType *indices, FloatType *data, size_t &n, size_t &maxcol, bool &bad) {
+            FloatType label;
+            const char *p(fastfloat::parse(lb, le, label));
+            n = 0;
+            bool sorted(true);
+            for(;;) {
+                while(p < le && (*p == ' ' || *p == '\t')) ++p;
+                if(p == le || *p == '\r') break;
+                size_t index;
+                const char *const colon(fastfloat::parse_integer(p, le, index));
+                if(colon == p || colon == le || *colon != ':' || index == 0 || index - 1 > std::numeric_limits<IndexType>::max()) {
+                    bad = true;
+                    break;
+                }
+                if(n && indices[n - 1] == index - 1) {
+                    bad = true; // Duplicate column.
+                    break;
+                }
+                if(n && indices[n - 1] > index - 1) sorted = false;
+                indices[n] = index - 1;
+                p = fastfloat::parse(colon + 1, le, data[n]);
+                maxcol = std::max(maxcol, index);
+                ++n;
+            }
+            if(!sorted) {
+                std::vector<std::pair<IndexType, FloatType>> tmp(n);
+                for(size_t k(0); k < n; ++k) tmp[k] = {indices[k], data[k]};
+                std::sort(tmp.begin(), tmp.end(), [](const auto &a, const auto &b) {return a.first < b.first;});
+                for(size_t k(0); k < n; ++k) indices[k] = tmp[k].first, data[k] = tmp[k].second;
+                if(std::adjacent_find(indices, indices + n) != indices + n) bad = true;
+            }
+            return label;
+        };
+        // A trailing "# ..." comment is not part of the row.
+        auto line_end = [](const char *lb, const char *le) {
+            const char *const hash(static_cast<const char *>(std::memchr(lb, '#', le - lb)));
+            return hash ? hash: le;
+        };
+        // Rows and entries (one per ':') of each chunk of a block.
+        auto count = [&](const char *begin, const std::vector<size_t> &bounds, std::vector<Chunk> &chunks) {
+            const int64_t nchunks(chunks.size());
+            #pragma omp parallel for schedule(dynamic) if(nchunks > 1)
+            for(int64_t c = 0; c < nchunks; ++c) {
+                io::for_each_line(begin + bounds[c], begin + bounds[c + 1], delim_, [&](const char *lb, const char *le) {
+                    if(!is_data_line(lb, le)) return;
+                    ++chunks[c].nrows;
+                    chunks[c].nnz += std::count(lb, line_end(lb, le), ':');
+                });
+            }
+        };
+        ret.clear();
+        std::vector<std::vector<size_t>> plan; // exact: (rows, entries) per chunk of each block, from the first pass.
+        if(exact) {
+            size_t nrows(0), nnz(0);
+            for_each_block([&](const char *begin, const char *end) {
+                const std::vector<size_t> bounds(io::line_chunks(begin, end, io::default_nchunks(), delim_));
+                std::vector<Chunk> chunks(bounds.size() - 1);
+                count(begin, bounds, chunks);
+                plan.emplace_back();
+                for(const auto &chunk: chunks) {
+                    plan.back().push_back(chunk.nrows), plan.back().push_back(chunk.nnz);
+                    nrows += chunk.nrows, nnz += chunk.nnz;
+                }
+            }, blocksz);
+            ret.indptr.reserve(nrows + 1);
+            ret.labels.reserve(nrows);
+            ret.indices.reserve(nnz);
+            ret.data.reserve(nnz);
         }
-        if(fp_ == nullptr) {
-            throw std::runtime_error(ks::sprintf("Could not open file at %s", path_.data()).data());
+        size_t block(0);
+        bool bad(false);
+        for_each_block([&](const char *begin, const char *end) {
+            const std::vector<size_t> bounds(io::line_chunks(begin, end, io::default_nchunks(), delim_));
+            const int64_t nchunks(bounds.size() - 1);
+            std::vector<Chunk> chunks(nchunks);
+            const size_t row0(ret.rows()), nnz0(ret.nnz());
+            if(exact) {
+                if(block == plan.size() || plan[block].size() != size_t(2 * nchunks)) throw std::runtime_error("Input changed between passes.");
+                for(int64_t c = 0; c < nchunks; ++c) chunks[c].nrows = plan[block][2 * c], chunks[c].nnz = plan[block][2 * c + 1];
+            }
+            ++block;
+            // Offsets of each chunk's rows and entries, known up front only in the exact case.
+            std::vector<size_t> rowoff(nchunks + 1, row0), nnzoff(nchunks + 1, nnz0);
+            if(exact) {
+                for(int64_t c = 0; c < nchunks; ++c)
+                    rowoff[c + 1] = rowoff[c] + chunks[c].nrows, nnzoff[c + 1] = nnzoff[c] + chunks[c].nnz;
+                ret.indptr.resize(rowoff[nchunks] + 1);
+                ret.labels.resize(rowoff[nchunks]);
+                ret.indices.resize(nnzoff[nchunks]);
+                ret.data.resize(nnzoff[nchunks]);
+            }
+            #pragma omp parallel for schedule(dynamic) if(nchunks > 1)
+            for(int64_t c = 0; c < nchunks; ++c) {
+                Chunk &chunk(chunks[c]);
+                size_t row(0), nnz(0);
+                io::for_each_line(begin + bounds[c], begin + bounds[c + 1], delim_, [&](const char *lb, const char *le) {
+                    if(!is_data_line(lb, le) || chunk.bad || chunk.changed) return;
+                    le = line_end(lb, le);
+                    const size_t maxn(std::count(lb, le, ':'));
+                    IndexType *indices;
+                    FloatType *data;
+                    if(exact) {
+                        // Writing past the counted rows or entries would overrun the next chunk's slots.
+                        if(row == chunk.nrows || nnz + maxn > chunk.nnz) {
+                            chunk.changed = true;
+                            return;
+                        }
+                        indices = ret.indices.data() + nnzoff[c] + nnz, data = ret.data.data() + nnzoff[c] + nnz;
+                    } else {
+                        chunk.indices.resize(nnz + maxn);
+                        chunk.data.resize(nnz + maxn);
+                        indices = chunk.indices.data() + nnz, data = chunk.data.data() + nnz;
+                    }
+                    size_t n;
+                    const FloatType label(parse_line(lb, le, indices, data, n, chunk.maxcol, chunk.bad));
+                    nnz += n;
+                    if(exact) {
+                        if(n != maxn) chunk.bad = true; // Every ':' must belong to an entry, or the counts are off.
+                        ret.labels[rowoff[c] + row] = label;
+                        ret.indptr[rowoff[c] + row + 1] = nnzoff[c] + nnz;
+                    } else {
+                        chunk.labels.push_back(label);
+                        chunk.indptr.push_back(nnz);
+                    }
+                    ++row;
+                });
+                if(exact && !chunk.bad && (row != chunk.nrows || nnz != chunk.nnz)) chunk.changed = true;
+                chunk.nrows = row, chunk.nnz = nnz;
+            }
+            for(const auto &chunk: chunks) {
+                if(chunk.changed) throw std::runtime_error("Input changed between passes.");
+                bad |= chunk.bad;
+                ret.ncols = std::max(ret.ncols, chunk.maxcol);
+            }
+            if(bad || exact) return;
+            for(int64_t c = 0; c < nchunks; ++c)
+                rowoff[c + 1] = rowoff[c] + chunks[c].nrows, nnzoff[c + 1] = nnzoff[c] + chunks[c].nnz;
+            ret.indptr.resize(rowoff[nchunks] + 1);
+            ret.labels.resize(rowoff[nchunks]);
+            ret.indices.resize(nnzoff[nchunks]);
+            ret.data.resize(nnzoff[nchunks]);
+            #pragma omp parallel for schedule(dynamic) if(nchunks > 1)
+            for(int64_t c = 0; c < nchunks; ++c) {
+                const Chunk &chunk(chunks[c]);
+                std::copy(chunk.labels.begin(), chunk.labels.end(), ret.labels.data() + rowoff[c]);
+                std::copy(chunk.indices.begin(), chunk.indices.begin() + chunk.nnz, ret.indices.data() + nnzoff[c]);
+                std::copy(chunk.data.begin(), chunk.data.begin() + chunk.nnz, ret.data.data() + nnzoff[c]);
+                for(size_t i(0); i < chunk.nrows; ++i) ret.indptr[rowoff[c] + i + 1] = nnzoff[c] + chunk.indptr[i];
+            }
+        }, blocksz);
+        if(exact && block != plan.size()) throw std::runtime_error("Input changed between passes.");
+        if(bad) throw std::runtime_error(ks::sprintf("Malformed libsvm entry in %s", path_.data()).data());
+        return ret.rows();
+    }
+    LineIterator begin() {
+        using namespace io;
+        if(use_mmap_ && (map_ || map_file())) {
+            pos_ = map_;
+            LineIterator ret(*this);
+            return ++ret;
         }
+        in_.reset(); // Joins any decompression thread before reopening.
+        in_ = open_stream(path_, ctype_, threaded_);
+        begin_ = end_ = scanned_ = 0;
+        eof_ = false;
+        saved_at_ = nullptr;
         LineIterator ret(*this);
         return ++ret;
     }
@@ -189,8 +1003,9 @@ public:
         return LineIterator(*this);
     }
     ssize_t len() const {return len_;}
-    char *data() {return data_;}
-    const char *data() const {return data_;}
+    char *data() {return line_;}
+    const char *data() const {return line_;}
+    std::string_view view() const {return std::string_view(line_, len_ < 0 ? 0: len_);}
 };
 
 } // namespace frp
@@ -1,10 +1,17 @@
 #ifndef _GRFP_RAND_H__
 #define _GRFP_RAND_H__
+#include <atomic>
 #include <random>
 #include <ctime>
+#include <limits>
+#include <vector>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 #include "fastrange/fastrange.h"
 #include "include/thirdparty/fast_mutex.h"
 #include "frp/aesctr.h"
+#include "frp/ctrng.h"
 
 namespace rng {
 
@@ -69,8 +76,80 @@ struct ThreadsafeRandTwister: public RandTwister {
     }
 };
 
+/*
+ * Lock-free pool of per-thread generators with the RandTwister interface.
+ * Each thread draws from its own AES counter stream under the pool's seed, created on first use,
+ * so concurrent draws never contend and never overlap.
+ * Streams are numbered in order of first use, unless the pool is reproducible, in which case
+ * a thread's stream is its OpenMP thread number. The same seed and a static schedule then give
+ * the same values on every run (draws from outside a single OpenMP team may share a stream).
+ * seed() and set_reproducible() take effect in each thread at its next draw.
+ */
+class ThreadLocalRandPool {
+public:
+    using Engine     = aes::AesCtr<uint64_t, 8>;
+    using ResultType = Engine::result_type;
+
+    static const ResultType MAX     = std::numeric_limits<ResultType>::max();
+    static const ResultType MIN     = std::numeric_limits<ResultType>::min();
+    static constexpr double MAX_INV = 1. / static_cast<double>(MAX);
+private:
+    struct Slot {
+        Engine   gen_;
+        uint64_t epoch_ = 0; // 0: never seeded.
+    };
+    const size_t          id_;
+    std::atomic<uint64_t> seed_, epoch_, next_stream_;
+    std::atomic<bool>     reproducible_;
+
+    static size_t next_id() {
+        static std::atomic<size_t> id(0);
+        return id++;
+    }
+    Engine &local() {
+        thread_local std::vector<Slot> slots;
+        if(__builtin_expect(slots.size() <= id_, 0)) slots.resize(id_ + 1);
+        Slot &slot(slots[id_]);
+        const uint64_t epoch(epoch_.load(std::memory_order_acquire));
+        if(__builtin_expect(slot.epoch_ != epoch, 0)) {
+            uint64_t stream;
+            if(reproducible_.load(std::memory_order_relaxed)) {
+#ifdef _OPENMP
+                stream = omp_get_thread_num();
+#else
+                stream = 0;
+#endif
+            } else stream = next_stream_.fetch_add(1, std::memory_order_relaxed);
+            slot.gen_ = Engine(seed_.load(std::memory_order_relaxed), stream);
+            slot.epoch_ = epoch;
+        }
+        return slot.gen_;
+    }
+public:
+    ThreadLocalRandPool(ResultType seed=0, bool reproducible=false):
+        id_(next_id()), seed_(seed), epoch_(1), next_stream_(0), reproducible_(reproducible) {}
+    ThreadLocalRandPool(const ThreadLocalRandPool &) = delete;
+    ThreadLocalRandPool &operator=(const ThreadLocalRandPool &) = delete;
+    void seed(ResultType seed) {
+        seed_.store(seed, std::memory_order_relaxed);
+        next_stream_.store(0, std::memory_order_relaxed);
+        epoch_.fetch_add(1, std::memory_order_release);
+    }
+    void reseed(ResultType seed) {this->seed(seed);}
+    void set_reproducible(bool reproducible) {
+        reproducible_.store(reproducible, std::memory_order_relaxed);
+        seed(seed_.load(std::memory_order_relaxed));
+    }
+    bool reproducible() const {return reproducible_.load(std::memory_order_relaxed);}
+    ResultType operator()() {return local()();}
+    // Generate a large number of random integers.
+    void operator()(size_t n, ResultType *a) {local().fill(a, n * sizeof(ResultType));}
+    // The calling thread's generator, for passing to distributions or std::shuffle.
+    Engine &engine() {return local();}
+};
+
 static RandTwister random_twist(std::time(nullptr));
-static ThreadsafeRandTwister tsrandom_twist(std::time(nullptr) + 1);
+static ThreadLocalRandPool tsrandom_twist(std::time(nullptr) + 1);
 
 // Based on https://github.com/lemire/FastShuffleExperiments/blob/master/cpp/rangedrand.h
 // map random value to [0,range) with slight bias, redraws to avoid bias if
@@ -99,7 +178,7 @@ static inline uint64_t random_bounded_nearlydivisionless64(uint64_t range) {
 }
 
 static inline uint64_t tsrandom_bounded_nearlydivisionless64(uint64_t range) {
-    return random_bounded_nearlydivisionless64<rng::ThreadsafeRandTwister>(range, tsrandom_twist);
+    return random_bounded_nearlydivisionless64<rng::ThreadLocalRandPool>(range, tsrandom_twist);
 }
 
 template<typename T>
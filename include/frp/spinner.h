@@ -10,6 +10,7 @@
 #include "boost/math/special_functions/detail/igamma_inverse.hpp"
 #include <array>
 #include <functional>
+#include <variant>
 
 namespace frp {
 template<typename T>
@@ -61,6 +62,17 @@ struct SDBlock {
         d_.apply(out); // Element-wise multiplication.
         s_.apply(out); // Structured-matrix multiplication.
     }
+    // (SD)^T = D^T S^T: transpose the structured block first.
+    template<typename OutVector>
+    void apply_transpose(OutVector &out) {
+        s_.apply_transpose(out);
+        d_.apply_transpose(out);
+    }
+    template<typename MatrixType>
+    void apply_many(MatrixType &out) {
+        d_.apply_many(out);
+        s_.apply_many(out);
+    }
 };
 
 
@@ -94,6 +106,14 @@ public:
         pv(out); std::cerr << '\n';
 #endif
     }
+    template<typename MatrixType>
+    void apply_many(MatrixType &out) const {
+        static_assert(is_soa_batch<MatrixType>::value, "apply_many expects an interleaved (column-major) batch whose rows are vectors.");
+        if(out.columns() != vec_.size()) throw std::runtime_error("Wrong batch dimension for scaling block.");
+        for(size_t i(0); i < vec_.size(); ++i) column(out, i) *= vec_[i];
+    }
+    template<typename Vector>
+    void apply_transpose(Vector &out) const {apply(out);} // Diagonal, so symmetric.
     FloatType vec_norm() const {return norm(vec_);}
     size_t size() const {return vec_.size();}
     void rescale(FloatType val) {
@@ -112,6 +132,15 @@ struct AdditionBlock {
     void apply(Vector &out) const {
         out += v_;
     }
+    template<typename MatrixType>
+    void apply_many(MatrixType &out) const {
+        for(size_t i(0); i < out.columns(); ++i)
+            for(auto &el: column(out, i)) el += v_;
+    }
+    template<typename Vector>
+    void apply_transpose(Vector &out) const {
+        throw runtime_error("AdditionBlock is affine, not linear, and has no transpose.");
+    }
     AdditionBlock(FloatType val): v_(val) {}
 };
 
@@ -131,6 +160,12 @@ struct ProductBlock {
     void apply(Vector &out) const {
         out *= v_;
     }
+    template<typename MatrixType>
+    void apply_many(MatrixType &out) const {
+        out *= v_;
+    }
+    template<typename Vector>
+    void apply_transpose(Vector &out) const {apply(out);}
     ProductBlock(FloatType val): v_(val) {}
 };
 
@@ -152,14 +187,21 @@ public:
     void apply(Vector &out) const {
         out *= 1. / (sigma_ * std::sqrt(out.size()));
     }
+    template<typename MatrixType>
+    void apply_many(MatrixType &out) const {
+        out *= 1. / (sigma_ * std::sqrt(out.columns()));
+    }
+    template<typename Vector>
+    void apply_transpose(Vector &out) const {apply(out);}
     size_t size() const {return -1;}
 };
 
 template<typename FloatType, typename=enable_if_t<is_floating_point<FloatType>::value>>
 class SORFProductBlock {
     const FloatType sigma_;
+    FloatType       scale_; // Extra factors folded in by the owner, e.g., Hadamard normalization.
 public:
-    SORFProductBlock(FloatType sigma): sigma_(sigma) {}
+    SORFProductBlock(FloatType sigma): sigma_(sigma), scale_(1) {}
     template<typename InVector, typename OutVector>
     void apply(const InVector &in, OutVector &out) const {
         if(in.size() == out.size()) {
@@ -172,8 +214,15 @@ public:
     template<typename Vector>
     void apply(Vector &out) const {
         //static_assert(std::is_same<std::decay_t<decltype(*std::begin(out))>, FloatType>::value, "Output vector must have the same type as the block type.");
-        out *= (std::sqrt(FloatType(out.size())) / sigma_);
+        out *= (std::sqrt(FloatType(out.size())) * scale_ / sigma_);
+    }
+    template<typename MatrixType>
+    void apply_many(MatrixType &out) const {
+        out *= (std::sqrt(FloatType(out.columns())) * scale_ / sigma_);
     }
+    template<typename Vector>
+    void apply_transpose(Vector &out) const {apply(out);}
+    void rescale(FloatType val) {scale_ *= val;}
     size_t size() const {return -1;}
 };
 
@@ -184,7 +233,7 @@ public:
     template<typename...Args>
     RandomGaussianScalingBlock(uint64_t seed, Args &&...args): ScalingBlock<FloatType, VectorOrientation, VectorKind>(forward<Args>(args)...) {
         //std::fprintf(stderr, "[%s] Size of scaling block: %zu\n", __PRETTY_FUNCTION__, vec_.size());
-        unit_gaussian_fill(ScalingBlock<FloatType, VectorOrientation, VectorKind>::vec_, seed);
+        chunked_sample_fill<VectorType, fast_unit_normal>(ScalingBlock<FloatType, VectorOrientation, VectorKind>::vec_, seed);
     }
 };
 template<typename FloatType, bool VectorOrientation=blaze::columnVector, template<typename, bool> typename VectorKind=blaze::DynamicVector, bool high_prec=true>
@@ -193,30 +242,25 @@ class RandomGammaIncInvScalingBlock: public ScalingBlock<FloatType, VectorOrient
 public:
     template<typename...Args>
     RandomGammaIncInvScalingBlock(uint64_t seed, Args &&...args): ScalingBlock<FloatType, VectorOrientation, VectorKind>(forward<Args>(args)...) {
-        uniform_fill(ScalingBlock<FloatType, VectorOrientation, VectorKind>::vec_, seed, 0, 1);
-        const FloatType val(this->vec_.size());
+        auto &v(this->vec_);
+        chunked_sample_fill<VectorType, fast_uniform>(v, seed);
+        const FloatType val(v.size());
+        const int64_t n(v.size());
+        // gamma_p_inv dominates construction. Elements are independent, so this is deterministic.
+        #pragma omp parallel for schedule(dynamic, 256)
+        for(int64_t i = 0; i < n; ++i) v[i] = boost::math::gamma_p_inv(val, v[i]);
         using Space = vec::SIMDTypes<FloatType>;
-        using PackedType = typename Space::Type;
-        PackedType el, *ptr((PackedType *)&this->vec_[0]);
-        PackedType two(Space::set1(2.));
-        if constexpr(high_prec) {
-            for(size_t i(this->vec_.size() / Space::COUNT); --i;) {
-                el = Space::load((FloatType *)&ptr[i]);
-                for(u32 j(0); j < Space::COUNT; ++j) el[j] = boost::math::gamma_p_inv(val, el[j]);
-                el = Space::mul(el, two);
-                el = Space::sqrt_u05(el);
-                Space::store((FloatType *)&ptr[i], el);
-            }
-        } else {
-            for(size_t i(this->vec_.size() / Space::Count); --i;) {
-                --i;
-                el = Space::load((FloatType *)&ptr[i - 1]);
-                for(u32 j(0); j < Space::COUNT; ++j) el[j] = boost::math::gamma_p_inv(val, el[j]);
-                el = Space::mul(el, two);
-                el = Space::sqrt_u35(el);
-                Space::store((FloatType *)&ptr[i - 1], el);
-            }
+        const typename Space::Type two(Space::set1(2.));
+        FloatType *ptr(&v[0]);
+        const int64_t nsimd(n / Space::COUNT);
+        #pragma omp parallel for
+        for(int64_t i = 0; i < nsimd; ++i) {
+            auto el(Space::mul(Space::loadu(ptr + i * Space::COUNT), two));
+            if constexpr(high_prec) el = Space::sqrt_u05(el);
+            else                    el = Space::sqrt_u35(el);
+            Space::storeu(ptr + i * Space::COUNT, el);
         }
+        for(int64_t i = nsimd * Space::COUNT; i < n; ++i) ptr[i] = std::sqrt(ptr[i] * 2);
     }
 };
 
@@ -228,7 +272,7 @@ public:
     template<typename...Args>
     RandomChiScalingBlock(uint64_t seed, Args &&...args): ScalingBlock<FloatType, VectorOrientation, VectorKind>(forward<Args>(args)...) {
         using SqrtStruct = typename vec::SIMDTypes<FloatType>::apply_sqrt_u05;
-        chisq_fill(vec_, seed);
+        chunked_sample_fill<VectorType, fast_chi_squared>(vec_, seed);
         vec::block_apply(vec_, SqrtStruct());
     }
 };
@@ -242,7 +286,7 @@ public:
     template<typename...Args>
     GaussianScalingBlock(uint64_t seed=0, FloatType mean=0., FloatType var=1., Args &&...args):
             ScalingBlock<FloatType, VectorOrientation, VectorKind>(forward<Args>(args)...) {
-        gaussian_fill(vec_, seed, mean, var);
+        chunked_sample_fill<VectorType, fast_normal, RNG>(vec_, seed, mean, var);
     }
 };
 
@@ -253,10 +297,109 @@ class UnitGaussianScalingBlock: public ScalingBlock<FloatType, VectorOrientation
 public:
     template<typename...Args>
     UnitGaussianScalingBlock(uint64_t seed=0, Args &&...args): ScalingBlock<FloatType, VectorOrientation, VectorKind>(forward<Args>(args)...) {
-        unit_gaussian_fill(this->vec_, seed);
+        chunked_sample_fill<VectorType, fast_unit_normal, RNG>(this->vec_, seed);
+    }
+};
+
+/*
+ * Implicit counterparts to the scaling blocks above.
+ * Like PRNRademacher, these store only a seed and regenerate the diagonal while applying it,
+ * so memory is O(1) per block.
+ * Values are drawn chunk by chunk exactly as chunked_sample_fill does, so a PRN block
+ * applies the same diagonal as the explicit block built from the same seed.
+ */
+template<typename FloatType, template<typename> typename Distribution, bool take_sqrt=false, typename RNG=aes::AesCtr<uint64_t>>
+class PRNScalingBlock {
+    static constexpr size_t BUFSIZE = SAMPLE_FILL_BLOCK;
+    size_t                      n_;
+    uint64_t                 seed_;
+    FloatType               scale_;
+    Distribution<FloatType>  dist_;
+
+    // Calls func(offset, values, len) on consecutive runs of the diagonal.
+    template<typename Functor>
+    void for_each_run(const Functor &func) const {
+        FloatType buf[BUFSIZE];
+        for(size_t c(0), start(0); start < n_; ++c, start += SAMPLE_FILL_CHUNK) {
+            RNG gen(detail::make_substream<RNG>(seed_, c));
+            auto dist(dist_);
+            const size_t end(std::min(n_, start + SAMPLE_FILL_CHUNK));
+            for(size_t i(start); i < end; i += BUFSIZE) {
+                const size_t len(std::min(BUFSIZE, end - i));
+                detail::draw(dist, buf, len, gen);
+                for(size_t j(0); j < len; ++j) {
+                    if constexpr(take_sqrt) buf[j] = std::sqrt(buf[j]) * scale_;
+                    else                    buf[j] *= scale_;
+                }
+                func(i, static_cast<const FloatType *>(buf), len);
+            }
+        }
+    }
+public:
+    template<typename... DistArgs>
+    PRNScalingBlock(uint64_t seed=0, size_t n=0, DistArgs &&... args):
+        n_(n), seed_(seed), scale_(1), dist_(forward<DistArgs>(args)...) {}
+    template<typename InVector, typename OutVector>
+    void apply(const InVector &in, OutVector &out) const {
+        if(out.size() != in.size()) throw std::runtime_error("NotImplementedError");
+        out = in;
+        apply(out);
     }
+    template<typename Vector>
+    void apply(Vector &out) const {
+        if(out.size() != n_) throw std::runtime_error(ks::sprintf("Wrong size for PRNScalingBlock: %zu, not %zu.", out.size(), n_).data());
+        if(n_ > 1 && &out[1] - &out[0] == 1) {
+            for_each_run([&](size_t offset, const FloatType *vals, size_t len) {vec::vecmul(&out[offset], vals, len);});
+        } else {
+            for_each_run([&](size_t offset, const FloatType *vals, size_t len) {
+                for(size_t i(0); i < len; ++i) out[offset + i] *= vals[i];
+            });
+        }
+    }
+    template<typename MatrixType>
+    void apply_many(MatrixType &out) const {
+        static_assert(is_soa_batch<MatrixType>::value, "apply_many expects an interleaved (column-major) batch whose rows are vectors.");
+        if(out.columns() != n_) throw std::runtime_error("Wrong batch dimension for PRNScalingBlock.");
+        for_each_run([&](size_t offset, const FloatType *vals, size_t len) {
+            for(size_t i(0); i < len; ++i) column(out, offset + i) *= vals[i];
+        });
+    }
+    template<typename Vector>
+    void apply_transpose(Vector &out) const {apply(out);}
+    FloatType vec_norm() const {
+        FloatType sum(0);
+        for_each_run([&sum](size_t, const FloatType *vals, size_t len) {
+            for(size_t i(0); i < len; ++i) sum += vals[i] * vals[i];
+        });
+        return std::sqrt(sum);
+    }
+    size_t size() const {return n_;}
+    void resize(size_t newsize) {n_ = newsize;}
+    void seed(uint64_t newseed) {seed_ = newseed;}
+    void rescale(FloatType val) {scale_ *= val;}
 };
 
+template<typename FloatType, typename RNG=aes::AesCtr<uint64_t>>
+using PRNUnitGaussianScalingBlock = PRNScalingBlock<FloatType, fast_unit_normal, false, RNG>;
+template<typename FloatType, typename RNG=aes::AesCtr<uint64_t>>
+using PRNGaussianScalingBlock     = PRNScalingBlock<FloatType, fast_normal, false, RNG>;
+template<typename FloatType, typename RNG=aes::AesCtr<uint64_t>>
+using PRNChiScalingBlock          = PRNScalingBlock<FloatType, fast_chi_squared, true, RNG>;
+
+// Applies a diagonal block to every row of a dense matrix whose rows are vectors.
+// Row-major matrices get the diagonal materialized once and scale each contiguous row;
+// interleaved (column-major) batches scale whole columns through the block's apply_many.
+template<typename DiagBlock, typename MatrixType>
+void apply_diagonal_rows(const DiagBlock &d, MatrixType &out) {
+    if constexpr(is_soa_batch<MatrixType>::value) {
+        d.apply_many(out);
+    } else {
+        blaze::DynamicVector<typename MatrixType::ElementType, blaze::rowVector> diag(out.columns(), 1);
+        d.apply(diag);
+        for(size_t i(0); i < out.rows(); ++i) row(out, i) *= diag;
+    }
+}
+
 template<typename RademacherType>
 class HRBlock: public SDBlock<HadamardBlock, RademacherType> {
 public:
@@ -264,8 +407,9 @@ public:
     using HadamType = HadamardBlock;
     using SDType    = SDBlock<HadamType, RademType>;
     using size_type = typename RademType::size_type;
-    HRBlock(size_type n=0, size_type seed=0):
-        SDType(HadamType(), RademType(roundup(n), seed)) {}
+    // With renormalize=false, the owner is responsible for the n^{-1/2} factor.
+    HRBlock(size_type n=0, size_type seed=0, bool renormalize=true):
+        SDType(HadamType(0, renormalize), RademType(roundup(n), seed)) {}
     void resize(size_type newsize) {
         if(newsize & (newsize - 1))
             std::fprintf(stderr, "[W:%s] Resizing HR block to new size of %zu (from %zu, rounded up %zu)\n",
@@ -278,9 +422,11 @@ public:
         SDType::s_.seed(seed);
         SDType::d_.seed(seed);
     }
+    // Dense matrices are treated as batches with one vector per row.
     template<typename VecType>
     void apply(VecType &in) const {
-        SDType::d_.apply(in);
+        if constexpr(blaze::IsDenseMatrix<VecType>::value) apply_diagonal_rows(SDType::d_, in);
+        else                                               SDType::d_.apply(in);
         SDType::s_.apply(in);
     }
     template<typename FloatType>
@@ -289,6 +435,22 @@ public:
         SDType::d_.apply(in);
         SDType::s_.apply(in,  l2s);
     }
+    template<typename VecType>
+    void apply_transpose(VecType &in) const {
+        SDType::s_.apply_transpose(in);
+        SDType::d_.apply_transpose(in);
+    }
+    template<typename FloatType>
+    void apply_transpose(FloatType *in) const {
+        const size_t l2s(log2_64(SDType::d_.size()));
+        SDType::s_.apply_transpose(in, l2s);
+        SDType::d_.apply_transpose(in);
+    }
+    template<typename MatrixType>
+    void apply_many(MatrixType &out) const {
+        SDType::d_.apply_many(out);
+        SDType::s_.apply_many(out);
+    }
 };
 
 using HadamardRademacherSDBlock = HRBlock<CompactRademacher>;
@@ -340,6 +502,34 @@ public:
             swap(vec[i-1], vec[fastrange<SizeType>(rng_(), i)]);
         }
     }
+    template<typename MatrixType>
+    void apply_many(MatrixType &out) const {
+        static_assert(is_soa_batch<MatrixType>::value, "apply_many expects an interleaved (column-major) batch whose rows are vectors.");
+        rng_.seed(seed_);
+        for(auto i(out.columns()); i > 1; --i) {
+            const auto j(fastrange<SizeType>(rng_(), i));
+            if(j != i - 1) swap_soa_columns(out, i - 1, j);
+        }
+    }
+    // Inverse permutation: undoes apply's swaps in reverse order.
+    // The draw for swap i is apply's (size - i)th, which counter-based generators compute directly;
+    // other generators replay the sequence into a buffer first.
+    template<typename Vector>
+    void apply_transpose(Vector &vec) const {
+        using std::swap;
+        const size_t n(vec.size());
+        if(n < 2) return;
+        rng_.seed(seed_);
+        if constexpr(rng::is_counter_based<RNG>::value) {
+            for(size_t i(2); i <= n; ++i)
+                swap(vec[i-1], vec[fastrange<SizeType>(rng_[n - i], i)]);
+        } else {
+            std::vector<ResultType> draws(n - 1);
+            for(auto &draw: draws) draw = rng_();
+            for(size_t i(2); i <= n; ++i)
+                swap(vec[i-1], vec[fastrange<SizeType>(draws[n - i], i)]);
+        }
+    }
     size_t size() const {return -1;}
 };
 
@@ -365,6 +555,18 @@ public:
             std::swap(vec[i], vec[indices_[i]]);
         }
     }
+    template<typename MatrixType>
+    void apply_many(MatrixType &out) const {
+        static_assert(is_soa_batch<MatrixType>::value, "apply_many expects an interleaved (column-major) batch whose rows are vectors.");
+        for(SizeType i(out.columns() - 1); i > 1; --i)
+            if(indices_[i] != i) swap_soa_columns(out, i, indices_[i]);
+    }
+    // Inverse permutation: the same swaps, in reverse order.
+    template<typename Vector>
+    void apply_transpose(Vector &vec) const {
+        for(SizeType i(2); i < vec.size(); ++i)
+            std::swap(vec[i], vec[indices_[i]]);
+    }
     template<typename Vector1, typename Vector2>
     void apply(const Vector1 &in, Vector2 &out) const {
         out = in;
@@ -390,6 +592,32 @@ public:
             out[i] = in[indices_[i]];
         }
     }
+    // Inverse permutation: scatters where apply gathers.
+    template<typename Vector>
+    void apply_transpose(Vector &vec) const {
+        blaze::DynamicVector<decay_t<decltype(vec[0])>, TransposeFlag<Vector>::value> tmp(vec.size());
+        tmp = vec;
+        apply_transpose(tmp, vec);
+    }
+    template<typename Vector1, typename Vector2>
+    void apply_transpose(const Vector1 &in, Vector2 &out) const {
+        for(SizeType i(0); i < in.size(); ++i) {
+            out[indices_[i]] = in[i];
+        }
+    }
+    // Gathers whole columns, so each index is loaded once per batch.
+    template<typename MatrixType1, typename MatrixType2>
+    void apply_many(const MatrixType1 &in, MatrixType2 &out) const {
+        static_assert(is_soa_batch<MatrixType1>::value && is_soa_batch<MatrixType2>::value,
+                      "apply_many expects interleaved (column-major) batches whose rows are vectors.");
+        for(SizeType i(0); i < in.columns(); ++i)
+            column(out, i) = column(in, indices_[i]);
+    }
+    template<typename MatrixType>
+    void apply_many(MatrixType &out) const {
+        blaze::DynamicMatrix<typename MatrixType::ElementType, blaze::columnMajor> tmp(out);
+        apply_many(tmp, out);
+    }
 };
 
 
@@ -460,9 +688,172 @@ public:
         //std::fprintf(stderr, "[%s:%d] Applied on size %zu\n", __PRETTY_FUNCTION__, __LINE__, out.size());
         as(out);
     }
+    // Applies every block to an interleaved batch (see is_soa_batch), last block first.
+    template<typename MatrixType, size_t Index=NBLOCKS>
+    void apply_many(MatrixType &out) const {
+        if constexpr(Index > 0) {
+            std::get<Index - 1>(blocks_).apply_many(out);
+            apply_many<MatrixType, Index - 1>(out);
+        }
+    }
+    // Applies the transpose of the whole product: each block's transpose, first block first.
+    template<typename OutVector, size_t Index=0>
+    void apply_transpose(OutVector &out) const {
+        if constexpr(Index < NBLOCKS) {
+            std::get<Index>(blocks_).apply_transpose(out);
+            apply_transpose<OutVector, Index + 1>(out);
+        }
+    }
+    template<typename InVector, typename OutVector>
+    void apply_transpose(const InVector &in, OutVector &out) const {
+        if(in.size() != out.size()) throw runtime_error("NotImplemented: apply_transpose between vectors of different sizes.");
+        out = in;
+        apply_transpose(out);
+    }
     auto &get_tuple() {return blocks_;}
 };
 
+/*
+ * Runtime-configured counterpart to SpinBlockTransformer.
+ * The spec is a comma-separated list of single-letter block codes, e.g. "R,H,G,P,H,R,S":
+ *   H: HadamardBlock
+ *   R: Rademacher diagonal (CompactRademacher, or PRNRademacher unless n is a multiple of 64)
+ *   G: UnitGaussianScalingBlock
+ *   S: RandomChiScalingBlock
+ *   P: LutShuffler permutation
+ * As with SpinBlockTransformer's template arguments, blocks are listed in matrix-product order,
+ * so the rightmost block is applied first.
+ * Blocks are held by value in a vector of variants, so application only dispatches once per block, not per element,
+ * and allocates only when a thread first needs a larger permutation buffer. Transformers can be shared between threads.
+ * When the spec has a G or S block, Hadamard normalization is folded into the first one
+ * instead of costing a pass per Hadamard.
+ */
+template<typename FloatType>
+class DynamicSpinTransformer {
+public:
+    using ShufflerType = LutShuffler<uint32_t>;
+    using BlockType    = std::variant<HadamardBlock, CompactRademacher, PRNRademacher,
+                                      UnitGaussianScalingBlock<FloatType>, RandomChiScalingBlock<FloatType>,
+                                      ShufflerType>;
+private:
+    size_t                                   n_;
+    std::string                           spec_;
+    std::vector<BlockType>              blocks_;
+
+    static std::vector<char> parse_spec(const std::string &spec) {
+        std::vector<char> ret;
+        for(const char c: spec) {
+            switch(c) {
+                case 'H': case 'R': case 'G': case 'S': case 'P': ret.push_back(c); break;
+                case ',': case ' ': case '\t': break;
+                default: throw std::runtime_error(std::string("Unknown block code '") + c + "' in spec \"" + spec + '"');
+            }
+        }
+        if(ret.empty()) throw std::runtime_error("Empty spec for DynamicSpinTransformer.");
+        return ret;
+    }
+
+    // Permutations can't be applied in place, so they read from a per-thread copy;
+    // the transformer itself stays safe to share between threads.
+    template<typename VecType>
+    static blaze::DynamicVector<FloatType> &copy_to_scratch(const VecType &out) {
+        thread_local blaze::DynamicVector<FloatType> scratch;
+        if constexpr(blaze::TransposeFlag<VecType>::value == blaze::columnVector) scratch = out;
+        else                                                                      scratch = trans(out);
+        return scratch;
+    }
+    template<typename Block, typename VecType>
+    void apply_block(const Block &block, VecType &out) const {
+        if constexpr(is_same<Block, ShufflerType>::value) {
+            block.apply(copy_to_scratch(out), out);
+        } else {
+            block.apply(out);
+        }
+    }
+    template<typename Block, typename MatrixType>
+    void apply_block_many(const Block &block, MatrixType &out) const {
+        if constexpr(is_same<Block, ShufflerType>::value) {
+            thread_local blaze::DynamicMatrix<FloatType, blaze::columnMajor> scratch;
+            scratch = out;
+            block.apply_many(scratch, out);
+        } else {
+            block.apply_many(out);
+        }
+    }
+    template<typename Block, typename VecType>
+    void apply_block_transpose(const Block &block, VecType &out) const {
+        if constexpr(is_same<Block, ShufflerType>::value) {
+            block.apply_transpose(copy_to_scratch(out), out);
+        } else {
+            block.apply_transpose(out);
+        }
+    }
+public:
+    DynamicSpinTransformer(const std::string &spec, size_t n, uint64_t seed=0, bool renorm=true):
+        n_(n), spec_(spec)
+    {
+        const auto codes(parse_spec(spec_));
+        if(std::find(codes.begin(), codes.end(), 'H') != codes.end() && (n_ & (n_ - 1)))
+            throw std::runtime_error(ks::sprintf("Hadamard blocks require a power of two size, not %zu.", n_).data());
+        aes::AesCtr<uint64_t> gen(seed);
+        const auto nhadamards(std::count(codes.begin(), codes.end(), 'H'));
+        const bool fold(renorm && nhadamards && std::find_if(codes.begin(), codes.end(), [](char c) {return c == 'G' || c == 'S';}) != codes.end());
+        blocks_.reserve(codes.size());
+        for(const char c: codes) {
+            switch(c) {
+                case 'H': blocks_.emplace_back(std::in_place_type<HadamardBlock>, n_, renorm && !fold); break;
+                case 'R':
+                    // CompactRademacher holds whole 64-bit words, so it only covers multiples of 64.
+                    if(n_ >= 64 && n_ % 64 == 0) blocks_.emplace_back(std::in_place_type<CompactRademacher>, n_, gen());
+                    else         blocks_.emplace_back(std::in_place_type<PRNRademacher>, n_, gen());
+                    break;
+                case 'G': blocks_.emplace_back(std::in_place_type<UnitGaussianScalingBlock<FloatType>>, gen(), n_); break;
+                case 'S': blocks_.emplace_back(std::in_place_type<RandomChiScalingBlock<FloatType>>, gen(), n_); break;
+                case 'P': blocks_.emplace_back(std::in_place_type<ShufflerType>, n_, gen()); break;
+            }
+        }
+        if(fold) {
+            const FloatType scale(std::pow(static_cast<double>(n_), -0.5 * nhadamards));
+            for(auto &block: blocks_) {
+                if(auto p = std::get_if<UnitGaussianScalingBlock<FloatType>>(&block)) {p->rescale(scale); break;}
+                if(auto p = std::get_if<RandomChiScalingBlock<FloatType>>(&block))    {p->rescale(scale); break;}
+            }
+        }
+    }
+    template<typename OutVector>
+    void apply(OutVector &out) const {
+        if(out.size() != n_) throw std::runtime_error(ks::sprintf("Wrong size for DynamicSpinTransformer: %zu, not %zu.", out.size(), n_).data());
+        for(auto it(blocks_.rbegin()), eit(blocks_.rend()); it != eit; ++it)
+            std::visit([&](const auto &block) {this->apply_block(block, out);}, *it);
+    }
+    // Copies in into the front of out, zero-padding the remainder, and transforms in place.
+    template<typename InVector, typename OutVector>
+    void apply(const InVector &in, OutVector &out) const {
+        if(in.size() > n_) throw std::runtime_error(ks::sprintf("Input (%zu) is larger than transform (%zu).", in.size(), n_).data());
+        subvector(out, 0, in.size()) = in;
+        blaze::reset(subvector(out, in.size(), n_ - in.size()));
+        apply(out);
+    }
+    // Interleaved batch version of apply: rows of out are vectors (see is_soa_batch).
+    template<typename MatrixType>
+    void apply_many(MatrixType &out) const {
+        static_assert(is_soa_batch<MatrixType>::value, "apply_many expects an interleaved (column-major) batch whose rows are vectors.");
+        if(out.columns() != n_) throw std::runtime_error(ks::sprintf("Wrong batch dimension for DynamicSpinTransformer: %zu, not %zu.", out.columns(), n_).data());
+        for(auto it(blocks_.rbegin()), eit(blocks_.rend()); it != eit; ++it)
+            std::visit([&](const auto &block) {this->apply_block_many(block, out);}, *it);
+    }
+    // Transposed product: blocks are applied leftmost first, each transposed.
+    template<typename OutVector>
+    void apply_transpose(OutVector &out) const {
+        if(out.size() != n_) throw std::runtime_error(ks::sprintf("Wrong size for DynamicSpinTransformer: %zu, not %zu.", out.size(), n_).data());
+        for(const auto &block: blocks_)
+            std::visit([&](const auto &b) {this->apply_block_transpose(b, out);}, block);
+    }
+    size_t size()    const {return n_;}
+    size_t nblocks() const {return blocks_.size();}
+    const std::string &spec() const {return spec_;}
+};
+
 } // namespace frp
 
 #endif // #ifndef _GFRP_SPINNER_H__
@@ -1,7 +1,13 @@
 #ifndef _GFRP_STACKSTRUCT_H__
 #define _GFRP_STACKSTRUCT_H__
+#include <cstring>
 #include <fstream>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
 #include "frp/util.h"
+#include "frp/dist.h"
+#include "frp/mach.h"
 #include "FFHT/fht.h"
 #include "fftw3.h"
 #include "vec/vec.h"
@@ -35,8 +41,19 @@ struct FFTTypes<float> {
     static constexpr decltype(&fftwf_plan_dft_1d) c2cplan1d = &fftwf_plan_dft_1d;
     static constexpr decltype(&fftwf_plan_r2r) r2rplan = &fftwf_plan_r2r;
     static constexpr decltype(&fftwf_plan_r2r_1d) r2rplan1d = &fftwf_plan_r2r_1d;
+    static constexpr decltype(&fftwf_plan_many_dft_r2c) r2cplanmany = &fftwf_plan_many_dft_r2c;
+    static constexpr decltype(&fftwf_plan_many_dft_c2r) c2rplanmany = &fftwf_plan_many_dft_c2r;
+    static constexpr decltype(&fftwf_plan_many_r2r)     r2rplanmany = &fftwf_plan_many_r2r;
+    static constexpr decltype(&fftwf_plan_many_dft)     c2cplanmany = &fftwf_plan_many_dft;
     static constexpr decltype(&fftwf_import_wisdom_from_filename) loadfn = &fftwf_import_wisdom_from_filename;
     static constexpr decltype(&fftwf_export_wisdom_to_filename) storefn = &fftwf_export_wisdom_to_filename;
+    static constexpr decltype(&fftwf_malloc)       mallocfn = &fftwf_malloc;
+    static constexpr decltype(&fftwf_free)         freefn = &fftwf_free;
+    static constexpr decltype(&fftwf_alignment_of) alignfn = &fftwf_alignment_of;
+#ifdef USE_FFTW_THREADS
+    static constexpr decltype(&fftwf_init_threads)       init_threads = &fftwf_init_threads;
+    static constexpr decltype(&fftwf_plan_with_nthreads) plan_with_nthreads = &fftwf_plan_with_nthreads;
+#endif
     static const char *suffix() {return "f";}
 };
 template<>
@@ -60,8 +77,19 @@ struct FFTTypes<double> {
     static constexpr decltype(&fftw_plan_dft_1d) c2cplan1d = &fftw_plan_dft_1d;
     static constexpr decltype(&fftw_plan_r2r) r2rplan = &fftw_plan_r2r;
     static constexpr decltype(&fftw_plan_r2r_1d) r2rplan1d = &fftw_plan_r2r_1d;
+    static constexpr decltype(&fftw_plan_many_dft_r2c) r2cplanmany = &fftw_plan_many_dft_r2c;
+    static constexpr decltype(&fftw_plan_many_dft_c2r) c2rplanmany = &fftw_plan_many_dft_c2r;
+    static constexpr decltype(&fftw_plan_many_r2r)     r2rplanmany = &fftw_plan_many_r2r;
+    static constexpr decltype(&fftw_plan_many_dft)     c2cplanmany = &fftw_plan_many_dft;
     static constexpr decltype(&fftw_import_wisdom_from_filename) loadfn = &fftw_import_wisdom_from_filename;
     static constexpr decltype(&fftw_export_wisdom_to_filename) storefn = &fftw_export_wisdom_to_filename;
+    static constexpr decltype(&fftw_malloc)       mallocfn = &fftw_malloc;
+    static constexpr decltype(&fftw_free)         freefn = &fftw_free;
+    static constexpr decltype(&fftw_alignment_of) alignfn = &fftw_alignment_of;
+#ifdef USE_FFTW_THREADS
+    static constexpr decltype(&fftw_init_threads)       init_threads = &fftw_init_threads;
+    static constexpr decltype(&fftw_plan_with_nthreads) plan_with_nthreads = &fftw_plan_with_nthreads;
+#endif
     static const char *suffix() {return "d";}
 };
 template<>
@@ -85,18 +113,469 @@ struct FFTTypes<long double> {
     static constexpr decltype(&fftwl_plan_dft_1d) c2cplan1d = &fftwl_plan_dft_1d;
     static constexpr decltype(&fftwl_plan_r2r) r2rplan = &fftwl_plan_r2r;
     static constexpr decltype(&fftwl_plan_r2r_1d) r2rplan1d = &fftwl_plan_r2r_1d;
+    static constexpr decltype(&fftwl_plan_many_dft_r2c) r2cplanmany = &fftwl_plan_many_dft_r2c;
+    static constexpr decltype(&fftwl_plan_many_dft_c2r) c2rplanmany = &fftwl_plan_many_dft_c2r;
+    static constexpr decltype(&fftwl_plan_many_r2r)     r2rplanmany = &fftwl_plan_many_r2r;
+    static constexpr decltype(&fftwl_plan_many_dft)     c2cplanmany = &fftwl_plan_many_dft;
     static constexpr decltype(&fftwl_import_wisdom_from_filename) loadfn = &fftwl_import_wisdom_from_filename;
     static constexpr decltype(&fftwl_export_wisdom_to_filename) storefn = &fftwl_export_wisdom_to_filename;
+    static constexpr decltype(&fftwl_malloc)       mallocfn = &fftwl_malloc;
+    static constexpr decltype(&fftwl_free)         freefn = &fftwl_free;
+    static constexpr decltype(&fftwl_alignment_of) alignfn = &fftwl_alignment_of;
+#ifdef USE_FFTW_THREADS
+    static constexpr decltype(&fftwl_init_threads)       init_threads = &fftwl_init_threads;
+    static constexpr decltype(&fftwl_plan_with_nthreads) plan_with_nthreads = &fftwl_plan_with_nthreads;
+#endif
     static const char *suffix() {return "ld";}
 };
 
+/*
+ * Process-wide FFTW plan cache.
+ * FFTW's planner is not thread-safe, so planning and wisdom I/O happen under one mutex.
+ * Plans are made on scratch arrays with the caller's alignment and run through the new-array
+ * execute functions, so a single plan serves every block and thread with the same parameters.
+ * Plans are keyed by transform, size, kind, planner flags, placement and alignment;
+ * each precision has its own cache.
+ * Wisdom is read once, on the first plan, from wisdom_path() plus a precision suffix,
+ * and written back at exit if planning added to it. The path defaults to $FRP_FFTW_WISDOM;
+ * when it is empty, wisdom is neither read nor written.
+ */
+enum TransformType: int {
+    R2R,
+    C2C,
+    R2C,
+    C2R,
+};
+
+// howmany, strides and distances describe many-transform (batched) plans; single transforms use 1, 1, 0.
+// nthreads is the number of threads FFTW may use inside the plan (only with USE_FFTW_THREADS).
+struct PlanKey {
+    int type, n, kind, flags, ialign, oalign;
+    bool oop;
+    int howmany = 1, istride = 1, idist = 0, ostride = 1, odist = 0;
+    int nthreads = 1;
+    bool operator==(const PlanKey &o) const {
+        return std::tie(type, n, kind, flags, ialign, oalign, oop, howmany, istride, idist, ostride, odist, nthreads)
+            == std::tie(o.type, o.n, o.kind, o.flags, o.ialign, o.oalign, o.oop, o.howmany, o.istride, o.idist, o.ostride, o.odist, o.nthreads);
+    }
+};
+
+struct PlanKeyHash {
+    size_t operator()(const PlanKey &k) const {
+        uint64_t h(k.n);
+        for(const int v: {k.type, k.kind, k.flags, k.ialign, k.oalign, int(k.oop), k.howmany, k.istride, k.idist, k.ostride, k.odist, k.nthreads})
+            h = (h ^ static_cast<uint64_t>(v)) * 0x9E3779B97F4A7C15ull;
+        return h ^ (h >> 32);
+    }
+};
+
+inline std::mutex &planner_mutex() {
+    static std::mutex mut;
+    return mut;
+}
+
+namespace detail {
+inline std::string &wisdom_path_ref() {
+    static std::string path(std::getenv("FRP_FFTW_WISDOM") ? std::getenv("FRP_FFTW_WISDOM"): "");
+    return path;
+}
+} // namespace detail
+
+// Wisdom is loaded when a precision plans for the first time, so set this before creating blocks.
+inline void set_wisdom_path(std::string path) {
+    std::lock_guard<std::mutex> lock(planner_mutex());
+    detail::wisdom_path_ref() = std::move(path);
+}
+inline std::string wisdom_path() {
+    std::lock_guard<std::mutex> lock(planner_mutex());
+    return detail::wisdom_path_ref();
+}
+
+// Batches with at least this many elements are planned with FFTW's threads, when built with USE_FFTW_THREADS.
+static constexpr size_t FFT_THREAD_THRESHOLD = size_t(1) << 18;
+
+namespace detail {
+inline int &max_threads_ref() {
+    static int nthreads(std::max(1u, std::thread::hardware_concurrency()));
+    return nthreads;
+}
+} // namespace detail
+
+// Upper bound on the threads given to a batched plan. Defaults to the hardware concurrency.
+inline void set_max_threads(int nthreads) {
+    std::lock_guard<std::mutex> lock(planner_mutex());
+    detail::max_threads_ref() = std::max(1, nthreads);
+}
+// Threads to plan a batch of nelem elements with: 1 unless FFTW threading is compiled in and the batch is large.
+inline int batch_threads(size_t nelem) {
+#ifdef USE_FFTW_THREADS
+    if(nelem >= FFT_THREAD_THRESHOLD) {
+        std::lock_guard<std::mutex> lock(planner_mutex());
+        return detail::max_threads_ref();
+    }
+#else
+    (void)nelem;
+#endif
+    return 1;
+}
+
+template<typename FloatType>
+class PlanCache {
+    using Types       = FFTTypes<FloatType>;
+    using PlanType    = typename Types::PlanType;
+    using ComplexType = typename Types::ComplexType;
+    static constexpr size_t ALIGN_PAD = 64;
+
+    std::unordered_map<PlanKey, PlanType, PlanKeyHash> plans_;
+    std::string fname_; // Wisdom file, resolved by load_wisdom(), so the destructor reads no other statics.
+    bool loaded_, dirty_;
+
+    PlanCache(): loaded_(false), dirty_(false) {
+        // Construct these before the cache, so they outlive it.
+        planner_mutex();
+        detail::wisdom_path_ref();
+#ifdef USE_FFTW_THREADS
+        std::lock_guard<std::mutex> lock(planner_mutex());
+        if(Types::init_threads() == 0) throw std::runtime_error("Could not initialize FFTW threads.");
+#endif
+    }
+    std::string wisdom_fname() const {
+        const auto &path(detail::wisdom_path_ref());
+        return path.empty() ? path: path + Types::suffix();
+    }
+    // Callers hold planner_mutex().
+    void load_wisdom() {
+        loaded_ = true;
+        fname_ = wisdom_fname();
+        if(fname_.size() && std::ifstream(fname_).good() && Types::loadfn(fname_.data()) == 0)
+            std::fprintf(stderr, "[W:%s] Could not load wisdom from %s\n", __PRETTY_FUNCTION__, fname_.data());
+    }
+    template<typename T>
+    static int alignment_of(const T *ptr) {
+        return Types::alignfn(reinterpret_cast<FloatType *>(const_cast<T *>(ptr)));
+    }
+    // Bytes spanned by howmany transforms of len elements each.
+    template<typename T>
+    static size_t extent(int len, int howmany, int stride, int dist) {
+        return (static_cast<size_t>(howmany - 1) * dist + static_cast<size_t>(len - 1) * stride + 1) * sizeof(T);
+    }
+    template<typename PlanFn>
+    PlanType get(const PlanKey &key, size_t ibytes, size_t obytes, const PlanFn &planfn) {
+        std::lock_guard<std::mutex> lock(planner_mutex());
+        auto it(plans_.find(key));
+        if(it != plans_.end()) return it->second;
+        if(!loaded_) load_wisdom();
+        // Planning may overwrite its arrays, so it never touches the caller's.
+        char *ibuf(static_cast<char *>(Types::mallocfn(ibytes + ALIGN_PAD)));
+        char *obuf(key.oop ? static_cast<char *>(Types::mallocfn(obytes + ALIGN_PAD)): ibuf);
+#ifdef USE_FFTW_THREADS
+        Types::plan_with_nthreads(key.nthreads);
+#endif
+        const PlanType plan(planfn(ibuf + key.ialign, obuf + (key.oop ? key.oalign: key.ialign)));
+#ifdef USE_FFTW_THREADS
+        Types::plan_with_nthreads(1);
+#endif
+        if(key.oop) Types::freefn(obuf);
+        Types::freefn(ibuf);
+        if(plan == nullptr) throw std::runtime_error(ks::sprintf("FFTW could not plan a transform of size %d.", key.n).data());
+        dirty_ = true;
+        return plans_.emplace(key, plan).first->second;
+    }
+public:
+    static PlanCache &instance() {
+        static PlanCache cache;
+        return cache;
+    }
+    PlanCache(const PlanCache &) = delete;
+    PlanCache &operator=(const PlanCache &) = delete;
+    ~PlanCache() {
+        if(dirty_ && fname_.size()) {
+            // Write then rename, so concurrent processes never see a partial file.
+            const std::string tmp(fname_ + ".tmp." + std::to_string(::getpid()));
+            if(Types::storefn(tmp.data()) == 0 || std::rename(tmp.data(), fname_.data()))
+                std::fprintf(stderr, "[W:%s] Could not store wisdom at %s\n", __PRETTY_FUNCTION__, fname_.data()), std::remove(tmp.data());
+        }
+        for(auto &pair: plans_) Types::destroy_fn(pair.second);
+    }
+    PlanType r2r(int n, fftw_r2r_kind kind, int flags, const FloatType *in, const FloatType *out) {
+        const bool oop(in != out);
+        const PlanKey key{R2R, n, static_cast<int>(kind), flags, alignment_of(in), oop ? alignment_of(out): 0, oop};
+        return get(key, n * sizeof(FloatType), n * sizeof(FloatType), [&](char *i, char *o) {
+            return Types::r2rplan1d(n, reinterpret_cast<FloatType *>(i), reinterpret_cast<FloatType *>(o), kind, flags);
+        });
+    }
+    PlanType c2c(int n, int sign, int flags, const ComplexType *in, const ComplexType *out) {
+        const bool oop(in != out);
+        const PlanKey key{C2C, n, sign, flags, alignment_of(in), oop ? alignment_of(out): 0, oop};
+        return get(key, n * sizeof(ComplexType), n * sizeof(ComplexType), [&](char *i, char *o) {
+            return Types::c2cplan1d(n, reinterpret_cast<ComplexType *>(i), reinterpret_cast<ComplexType *>(o), sign, flags);
+        });
+    }
+    // howmany in-place real-to-real transforms of n elements each, strided as described by stride and dist.
+    PlanType r2r_many(int n, fftw_r2r_kind kind, int flags, const FloatType *data, int howmany, int stride, int dist, int nthreads=1) {
+        const PlanKey key{R2R, n, static_cast<int>(kind), flags, alignment_of(data), 0, false, howmany, stride, dist, stride, dist, nthreads};
+        return get(key, extent<FloatType>(n, howmany, stride, dist), 0, [&](char *i, char *) {
+            FloatType *const p(reinterpret_cast<FloatType *>(i));
+            return Types::r2rplanmany(1, &n, howmany, p, nullptr, stride, dist, p, nullptr, stride, dist, &kind, flags);
+        });
+    }
+    PlanType c2c_many(int n, int sign, int flags, const ComplexType *data, int howmany, int stride, int dist, int nthreads=1) {
+        const PlanKey key{C2C, n, sign, flags, alignment_of(data), 0, false, howmany, stride, dist, stride, dist, nthreads};
+        return get(key, extent<ComplexType>(n, howmany, stride, dist), 0, [&](char *i, char *) {
+            ComplexType *const p(reinterpret_cast<ComplexType *>(i));
+            return Types::c2cplanmany(1, &n, howmany, p, nullptr, stride, dist, p, nullptr, stride, dist, sign, flags);
+        });
+    }
+    // Real-to-half-complex (n / 2 + 1 outputs) and back, optionally over howmany strided vectors.
+    PlanType r2c(int n, int flags, const FloatType *in, const ComplexType *out,
+                 int howmany=1, int istride=1, int idist=0, int ostride=1, int odist=0) {
+        const PlanKey key{R2C, n, 0, flags, alignment_of(in), alignment_of(out), true, howmany, istride, idist, ostride, odist};
+        return get(key, extent<FloatType>(n, howmany, istride, idist), extent<ComplexType>(n / 2 + 1, howmany, ostride, odist),
+                   [&](char *i, char *o) {
+            return Types::r2cplanmany(1, &n, howmany, reinterpret_cast<FloatType *>(i), nullptr, istride, idist,
+                                      reinterpret_cast<ComplexType *>(o), nullptr, ostride, odist, flags);
+        });
+    }
+    PlanType c2r(int n, int flags, const ComplexType *in, const FloatType *out,
+                 int howmany=1, int istride=1, int idist=0, int ostride=1, int odist=0) {
+        const PlanKey key{C2R, n, 0, flags, alignment_of(in), alignment_of(out), true, howmany, istride, idist, ostride, odist};
+        return get(key, extent<ComplexType>(n / 2 + 1, howmany, istride, idist), extent<FloatType>(n, howmany, ostride, odist),
+                   [&](char *i, char *o) {
+            return Types::c2rplanmany(1, &n, howmany, reinterpret_cast<ComplexType *>(i), nullptr, istride, idist,
+                                      reinterpret_cast<FloatType *>(o), nullptr, ostride, odist, flags);
+        });
+    }
+};
+
+// Element stride and vector distance of a dense batch whose rows are vectors.
+// Row-major rows are contiguous; an interleaved (column-major) batch keeps element i of every vector in column i.
+template<typename MatrixType>
+std::pair<int, int> batch_strides(const MatrixType &batch) {
+    static_assert(blaze::IsDenseMatrix<MatrixType>::value, "FFT batches must be dense matrices.");
+    const int spacing(batch.spacing());
+    if constexpr(blaze::IsColumnMajorMatrix<MatrixType>::value) return {spacing, 1};
+    else                                                        return {1, spacing};
+}
+
+// Smallest size >= n with no prime factors above 7, which FFTW transforms efficiently.
+inline size_t good_size(size_t n) {
+    if(n <= 1) return 1;
+    for(;; ++n) {
+        size_t m(n);
+        for(const size_t p: {2, 3, 5, 7}) while(m % p == 0) m /= p;
+        if(m == 1) return n;
+    }
+}
+
 } // namespace fft
 
 
+/*
+ * Interleaved (structure-of-arrays) batches.
+ * A batch is a column-major dense matrix whose rows are the vectors being transformed,
+ * so column i holds element i of every vector contiguously.
+ * Per-element parameters (diagonals, signs, permutations) are then loaded once per batch,
+ * and butterflies run across vectors in SIMD registers.
+ */
+template<typename MatrixType>
+struct is_soa_batch {
+    static constexpr bool value = blaze::IsDenseMatrix<MatrixType>::value && blaze::IsColumnMajorMatrix<MatrixType>::value;
+};
+
+template<typename MatrixType>
+void swap_soa_columns(MatrixType &m, size_t i, size_t j) {
+    auto *a(m.data() + i * m.spacing()), *b(m.data() + j * m.spacing());
+    std::swap_ranges(a, a + m.rows(), b);
+}
+
+namespace detail {
+
+template<bool SCALE, typename FloatType>
+void fht_interleaved_radix2(FloatType *data, size_t n, size_t h, size_t nvec, size_t stride, FloatType scale) {
+    for(size_t i(0); i < n; i += h << 1) {
+        for(size_t j(i); j < i + h; ++j) {
+            FloatType *__restrict__ a(data + j * stride), *__restrict__ b(data + (j + h) * stride);
+            for(size_t v(0); v < nvec; ++v) {
+                const FloatType x(a[v]), y(b[v]);
+                if constexpr(SCALE) a[v] = (x + y) * scale, b[v] = (x - y) * scale;
+                else                a[v] = x + y,           b[v] = x - y;
+            }
+        }
+    }
+}
+
+// Two butterfly levels (h and 2h) per sweep over the data.
+template<bool SCALE, typename FloatType>
+void fht_interleaved_radix4(FloatType *data, size_t n, size_t h, size_t nvec, size_t stride, FloatType scale) {
+    for(size_t i(0); i < n; i += h << 2) {
+        for(size_t j(i); j < i + h; ++j) {
+            FloatType *__restrict__ p0(data + j * stride),           *__restrict__ p1(data + (j + h) * stride),
+                      *__restrict__ p2(data + (j + (h << 1)) * stride), *__restrict__ p3(data + (j + 3 * h) * stride);
+            for(size_t v(0); v < nvec; ++v) {
+                const FloatType s0(p0[v] + p1[v]), s1(p0[v] - p1[v]), s2(p2[v] + p3[v]), s3(p2[v] - p3[v]);
+                if constexpr(SCALE) {
+                    p0[v] = (s0 + s2) * scale, p2[v] = (s0 - s2) * scale;
+                    p1[v] = (s1 + s3) * scale, p3[v] = (s1 - s3) * scale;
+                } else {
+                    p0[v] = s0 + s2, p2[v] = s0 - s2;
+                    p1[v] = s1 + s3, p3[v] = s1 - s3;
+                }
+            }
+        }
+    }
+}
+
+} // namespace detail
+
+// Unnormalized Walsh-Hadamard transform of nvec interleaved vectors of length n (a power of two).
+// Element i of vector v is at data[i * stride + v]. scale is folded into the last butterfly level.
+template<typename FloatType>
+void fht_interleaved(FloatType *data, size_t n, size_t nvec, size_t stride, FloatType scale=1) {
+    const bool doscale(scale != static_cast<FloatType>(1));
+    if(n == 1) {
+        if(doscale) for(size_t v(0); v < nvec; data[v++] *= scale);
+        return;
+    }
+    size_t h(1);
+    if(ilog2(n) & 1) {
+        if(n == 2 && doscale) detail::fht_interleaved_radix2<true>(data, n, h, nvec, stride, scale);
+        else                  detail::fht_interleaved_radix2<false>(data, n, h, nvec, stride, scale);
+        h = 2;
+    }
+    for(; h < n; h <<= 2) {
+        if((h << 2) == n && doscale) detail::fht_interleaved_radix4<true>(data, n, h, nvec, stride, scale);
+        else                         detail::fht_interleaved_radix4<false>(data, n, h, nvec, stride, scale);
+    }
+}
+
+namespace detail {
+
+// Elements per in-cache block of fht_blocked: the largest power of two filling half of L2.
+template<typename FloatType>
+size_t fht_block_size() {
+    static const size_t ret(std::max(size_t(1) << 10, size_t(1) << ilog2(mach::cache_sizes().l2 / 2 / sizeof(FloatType))));
+    return ret;
+}
+
+} // namespace detail
+
+// Vectors at least this long have their butterflies split across threads.
+static constexpr size_t FHT_PARALLEL_THRESHOLD = size_t(1) << 20;
+
+/*
+ * Cache-blocked Walsh-Hadamard transform for vectors that do not fit in L2.
+ * Viewing data as an (n / B) x B row-major matrix, where B elements fill half of L2:
+ * 1. Each row gets an in-cache ::fht, which performs the low log2(B) butterfly levels.
+ * 2. The remaining levels are a length-n/B transform down every column. These run as
+ *    interleaved transforms over column strips narrow enough to stay in L2 (but at least
+ *    a cache line wide), with scale folded into their last level.
+ * Rows and strips are independent, so both steps are split across threads for n >= FHT_PARALLEL_THRESHOLD.
+ */
+template<typename FloatType>
+void fht_blocked(FloatType *data, size_t n, FloatType scale=1) {
+    const size_t bs(detail::fht_block_size<FloatType>());
+    if(n <= bs) {
+        ::fht(data, log2_64(n));
+        if(scale != static_cast<FloatType>(1)) vec::blockmul(data, n, scale);
+        return;
+    }
+    const size_t nrows(n / bs), l2bs(log2_64(bs));
+    const size_t strip_target(mach::cache_sizes().l2 / 2 / (nrows * sizeof(FloatType)));
+    const size_t width(std::min(bs, std::max(64 / sizeof(FloatType), strip_target ? size_t(1) << ilog2(strip_target): size_t(1))));
+    const int64_t nstrips(bs / width);
+    const bool parallel(n >= FHT_PARALLEL_THRESHOLD);
+    #pragma omp parallel for schedule(static) if(parallel)
+    for(int64_t r = 0; r < static_cast<int64_t>(nrows); ++r)
+        ::fht(data + r * bs, l2bs);
+    #pragma omp parallel for schedule(static) if(parallel)
+    for(int64_t c = 0; c < nstrips; ++c)
+        fht_interleaved(data + c * width, nrows, width, bs, scale);
+}
+
+namespace detail {
+
+template<size_t N, size_t H, bool SCALE, typename FloatType>
+void fht_small_levels(FloatType *__restrict__ buf, FloatType scale) {
+    if constexpr(H < N) {
+        for(size_t i = 0; i < N; i += H << 1) {
+            for(size_t j = i; j < i + H; ++j) {
+                const FloatType x(buf[j]), y(buf[j + H]);
+                if constexpr(SCALE && (H << 1) == N) buf[j] = (x + y) * scale, buf[j + H] = (x - y) * scale;
+                else                                 buf[j] = x + y,           buf[j + H] = x - y;
+            }
+        }
+        fht_small_levels<N, (H << 1), SCALE>(buf, scale);
+    }
+}
+
+// Transform of one vector of length 2^LOG2 with every loop bound known at compile time,
+// worked on in a local copy so it can stay in registers. scale is folded into the last level.
+template<unsigned LOG2, bool SCALE, typename FloatType>
+void fht_small(FloatType *data, FloatType scale) {
+    constexpr size_t N(size_t(1) << LOG2);
+    FloatType buf[N];
+    std::memcpy(buf, data, sizeof(buf));
+    fht_small_levels<N, 1, SCALE>(buf, scale);
+    std::memcpy(data, buf, sizeof(buf));
+}
+
+template<unsigned LOG2, typename FloatType>
+void fht_small_rows(FloatType *data, size_t nrows, size_t stride, FloatType scale) {
+    const bool doscale(scale != static_cast<FloatType>(1));
+    #pragma omp parallel for schedule(static) if((nrows << LOG2) >= FHT_PARALLEL_THRESHOLD)
+    for(int64_t i = 0; i < static_cast<int64_t>(nrows); ++i) {
+        if(doscale) fht_small<LOG2, true>(data + i * stride, scale);
+        else        fht_small<LOG2, false>(data + i * stride, scale);
+    }
+}
+
+} // namespace detail
+
+/*
+ * Walsh-Hadamard transform of every row of a dense matrix, in place.
+ * Row-major rows of up to 512 elements use the compile-time kernels above; longer rows use fht_blocked.
+ * Column-major matrices are interleaved batches (see is_soa_batch) and use fht_interleaved.
+ * Renormalization is folded into the last butterfly level in every case.
+ */
+template<typename MatrixType>
+void fht_batch(MatrixType &m, bool renormalize=true) {
+    using FloatType = typename MatrixType::ElementType;
+    const size_t n(m.columns()), nrows(m.rows());
+    if(n & (n - 1)) throw runtime_error(ks::sprintf("batch dimension %zu not a power of two. NotImplemented.", n).data());
+    if(n <= 1 || nrows == 0) return;
+    const FloatType scale(renormalize ? static_cast<FloatType>(1. / std::sqrt(n)): static_cast<FloatType>(1));
+    if constexpr(blaze::IsColumnMajorMatrix<MatrixType>::value) {
+        fht_interleaved(m.data(), n, nrows, m.spacing(), scale);
+    } else {
+        FloatType *const data(m.data());
+        const size_t stride(m.spacing());
+        switch(ilog2(n)) {
+            case 1: detail::fht_small_rows<1>(data, nrows, stride, scale); break;
+            case 2: detail::fht_small_rows<2>(data, nrows, stride, scale); break;
+            case 3: detail::fht_small_rows<3>(data, nrows, stride, scale); break;
+            case 4: detail::fht_small_rows<4>(data, nrows, stride, scale); break;
+            case 5: detail::fht_small_rows<5>(data, nrows, stride, scale); break;
+            case 6: detail::fht_small_rows<6>(data, nrows, stride, scale); break;
+            case 7: detail::fht_small_rows<7>(data, nrows, stride, scale); break;
+            case 8: detail::fht_small_rows<8>(data, nrows, stride, scale); break;
+            case 9: detail::fht_small_rows<9>(data, nrows, stride, scale); break;
+            default: {
+                #pragma omp parallel for schedule(static) if(n < FHT_PARALLEL_THRESHOLD && n * nrows >= FHT_PARALLEL_THRESHOLD)
+                for(int64_t i = 0; i < static_cast<int64_t>(nrows); ++i)
+                    fht_blocked(data + i * stride, n, scale);
+            }
+        }
+    }
+}
+
 template<typename VecType>
 void fht(VecType &vec, bool renormalize=true) {
+    using FloatType = std::decay_t<decltype(vec[0])>;
     if(vec.size() & (vec.size() - 1)) {
         throw runtime_error(ks::sprintf("vec size %zu not a power of two. NotImplemented.", vec.size()).data());
+    } else if(vec.size() > detail::fht_block_size<FloatType>()) {
+        fht_blocked(&vec[0], vec.size(), renormalize ? static_cast<FloatType>(1. / std::sqrt(vec.size())): static_cast<FloatType>(1));
+        return;
     } else {
         ::fht(&vec[0], log2_64(vec.size()));
     }
@@ -107,6 +586,9 @@ template<template<typename, bool> typename VecType, typename FloatType, bool Vec
 void fht(VecType<FloatType, VectorOrientation> &vec, bool renormalize=true) {
     if(vec.size() & (vec.size() - 1)) {
         throw runtime_error(ks::sprintf("vec size %zu not a power of two. NotImplemented.", vec.size()).data());
+    } else if(vec.size() > detail::fht_block_size<FloatType>()) {
+        fht_blocked(&vec[0], vec.size(), renormalize ? static_cast<FloatType>(1. / std::sqrt(vec.size())): static_cast<FloatType>(1));
+        return;
     } else {
         ::fht(&vec[0], log2_64(vec.size()));
     }
@@ -160,12 +642,14 @@ struct HadamardBlock {
         }
         apply(out);
     }
+    // Dense matrices are transformed row by row (see fht_batch).
     template<typename OutVector>
     void apply(OutVector &out) const {
         if constexpr(blaze::IsSparseVector<OutVector>::value || blaze::IsSparseMatrix<OutVector>::value) {
             throw runtime_error("Fast Hadamard transform not implemented for sparse vectors yet.");
-        }
-        if((out.size() & (out.size() - 1)) == 0) {
+        } else if constexpr(blaze::IsDenseMatrix<OutVector>::value) {
+            fht_batch(out, renormalize_);
+        } else if((out.size() & (out.size() - 1)) == 0) {
             fht(out, renormalize_);
         } else {
             throw runtime_error("NotImplemented: either copy to another array, perform, and then subsample the last n rows, resize the output array.");
@@ -178,11 +662,18 @@ struct HadamardBlock {
             std::fprintf(stderr, "Warning: apply *should* take a log2 value. You're passing an impossibly large size.\n");
             nelem = log2_64(nelem);
         }
-        ::fht(pos, nelem);
-        if(renormalize_) {
-            const FloatType div(1./std::sqrt(static_cast<FloatType>(1 << nelem)));
-            vec::blockmul(pos, static_cast<size_t>(1) << nelem, div);
-        }
+        const size_t n(static_cast<size_t>(1) << nelem);
+        fht_blocked(pos, n, renormalize_ ? static_cast<FloatType>(1./std::sqrt(static_cast<FloatType>(n))): static_cast<FloatType>(1));
+    }
+    // The Walsh-Hadamard matrix is symmetric, with or without renormalization.
+    template<typename OutVector>
+    void apply_transpose(OutVector &out) const {apply(out);}
+    template<typename FloatType>
+    void apply_transpose(FloatType *pos, size_t nelem) const {apply(pos, nelem);}
+    template<typename MatrixType>
+    void apply_many(MatrixType &out) const {
+        static_assert(is_soa_batch<MatrixType>::value, "apply_many expects an interleaved (column-major) batch whose rows are vectors.");
+        fht_batch(out, renormalize_);
     }
     template<typename IntType>
     void resize([[maybe_unused]] IntType i) {/* Do nothing */}
@@ -211,12 +702,45 @@ template<typename FloatType>
 class RFFTBlock {
     static_assert(is_floating_point<FloatType>::value, "RFFTBlock must be floating point.");
     using fftplan_t = typename fft::FFTTypes<FloatType>::PlanType;
+    using PlanCache = fft::PlanCache<FloatType>;
 
-    fftplan_t plan_;
+    fftplan_t plan_; // Cached plan for aligned arrays of size n_. Owned by PlanCache.
     fftw_r2r_kind  kind_;
     int  n_, flags_;
     const bool oop_;
+    const bool orthonormal_;
 
+    // Arrays of a different size, kind or alignment get their own plan from the cache.
+    fftplan_t plan_for(int n, const FloatType *in, const FloatType *out, fftw_r2r_kind kind) const {
+        if(n == n_ && kind == kind_ && (in != out) == oop_ && fft::FFTTypes<FloatType>::alignfn(const_cast<FloatType *>(in)) == 0
+           && fft::FFTTypes<FloatType>::alignfn(const_cast<FloatType *>(out)) == 0)
+            return plan_;
+        return PlanCache::instance().r2r(n, kind, flags_, in, out);
+    }
+    fftplan_t plan_for(int n, const FloatType *in, const FloatType *out) const {return plan_for(n, in, out, kind_);}
+    // In-place transform of a, scaled by 1 / sqrt(2n).
+    // Orthonormal DCT-II additionally scales its first output by 1 / sqrt(2), and DCT-III its first input by sqrt(2),
+    // which makes them orthogonal and mutually transposed.
+    template<typename VecType>
+    void run(VecType &a, fftw_r2r_kind kind) const {
+        if(orthonormal_ && kind == FFTW_REDFT01) a[0] *= static_cast<FloatType>(M_SQRT2);
+        fft::FFTTypes<FloatType>::r2rexec(plan_for(a.size(), &a[0], &a[0], kind), &a[0], &a[0]);
+        a *= std::sqrt(1./(a.size()<<1));
+        if(orthonormal_ && kind == FFTW_REDFT10) a[0] *= static_cast<FloatType>(M_SQRT1_2);
+    }
+    // The same for every row of a, with one many-transform plan for the whole batch.
+    template<typename MatrixType>
+    void run_batch(MatrixType &a, fftw_r2r_kind kind) const {
+        const int n(a.columns()), howmany(a.rows());
+        if(n == 0 || howmany == 0) return;
+        const auto [stride, dist] = fft::batch_strides(a);
+        if(orthonormal_ && kind == FFTW_REDFT01) column(a, 0) *= static_cast<FloatType>(M_SQRT2);
+        FloatType *const p(a.data());
+        const auto plan(PlanCache::instance().r2r_many(n, kind, flags_, p, howmany, stride, dist, fft::batch_threads(size_t(n) * howmany)));
+        fft::FFTTypes<FloatType>::r2rexec(plan, p, p);
+        a *= std::sqrt(1./(n<<1));
+        if(orthonormal_ && kind == FFTW_REDFT10) column(a, 0) *= static_cast<FloatType>(M_SQRT1_2);
+    }
 
 public:
     const char *block_type() const {
@@ -224,226 +748,364 @@ public:
         return it == std::end(rfft::kinds) ? "UNKNOWN" : rfft::names[it - std::begin(rfft::kinds)];
     }
 
-    std::string wisdom_fname() const {
-        return std::string(block_type()) + fft::FFTTypes<FloatType>::suffix();
-    }
-    void load_wisdom() {
-        if(std::ifstream(wisdom_fname().data()).good()) {
-            if(fft::FFTTypes<FloatType>::loadfn(wisdom_fname().data()) == 0) {
-                throw std::runtime_error(ks::sprintf("Could not load wisdom from %s\n", wisdom_fname()).data());
-            } else {
-                std::fprintf(stderr, "Loaded wisdom from %s\n", wisdom_fname().data());
-            }
-        }
-    }
-    // Real FFT block
-    void destroy() {
-        if(plan_) {
-            fft::FFTTypes<FloatType>::destroy_fn(plan_);
-        }
+    void set_kind(fftw_r2r_kind kind) {
+        if(kind == kind_) return;
+        kind_ = kind;
+        const int n(n_);
+        n_ = 0;
+        resize(n); // Replan for the new kind.
     }
-    void set_kind(fftw_r2r_kind kind) { kind_  = kind;}
     void set_flags(int newflags) { flags_ = newflags;}
     void resize(int n) {
         if(n == n_) return;
         n_ = n;
-        blaze::DynamicVector<FloatType> tmpvec(n);
+        blaze::DynamicVector<FloatType> tmpvec(n), tmpvec2(oop_ ? n: 0);
         auto ptr1(&tmpvec[0]);
-        auto ptr2(oop_ ? ptr1: &blaze::DynamicVector<FloatType>(n)[0]);
-        destroy();
-        plan_ = fft::FFTTypes<FloatType>::r2rplan1d(n_, ptr1, ptr2, kind_, flags_);
+        auto ptr2(oop_ ? &tmpvec2[0]: ptr1);
+        plan_ = PlanCache::instance().r2r(n_, kind_, flags_, ptr1, ptr2);
     }
     RFFTBlock(int n, fftw_r2r_kind kind=FFTW_REDFT10,
-              bool oop=false, int flags=FFTW_PATIENT):
-                  plan_(nullptr), kind_(kind), n_(0), flags_(flags), oop_(oop)
+              bool oop=false, int flags=FFTW_PATIENT, bool orthonormal=false):
+                  plan_(nullptr), kind_(kind), n_(0), flags_(flags), oop_(oop), orthonormal_(orthonormal)
     {
-        load_wisdom();
+        if(orthonormal_ && kind_ != FFTW_REDFT10 && kind_ != FFTW_REDFT01)
+            throw std::runtime_error("Orthonormal scaling is only implemented for DCT-II/III.");
         resize(n);
     }
     template<typename VecType>
-    void execute(VecType &a) {
-        if(n_ != (int)a.size()) {
-            resize((int)a.size());
-        }
-        fft::FFTTypes<FloatType>::r2rexec(plan_, &a[0], &a[0]);
-        a *= std::sqrt(1./(a.size()<<1));
+    void execute(VecType &a) const {
+        run(a, kind_);
+    }
+    // Transforms each row of a dense matrix, in either storage order.
+    template<typename MatrixType>
+    void execute_batch(MatrixType &a) const {
+        run_batch(a, kind_);
     }
     template<typename VecType1, typename VecType2>
-    void execute(const VecType1 &in, VecType2 &out) {
+    void execute(const VecType1 &in, VecType2 &out) const {
         if(out.size() < in.size()) throw "ZOMG";
-        if(n_ != in.size()) {
-            resize((int)in.size());
+        if(orthonormal_) {
+            // The DCT-III fix-up modifies the input, so transform a copy in place.
+            auto sv(subvector(out, 0, in.size()));
+            sv = in;
+            run(sv, kind_);
+            return;
         }
-        fft::FFTTypes<FloatType>::r2rexec(plan_, &in[0], &out[0]);
+        // FFTW's r2r interface takes non-const input, even though out-of-place transforms preserve it.
+        FloatType *const ip(const_cast<FloatType *>(&in[0]));
+        fft::FFTTypes<FloatType>::r2rexec(plan_for(in.size(), ip, &out[0]), ip, &out[0]);
         out *= std::sqrt(1./(out.size()<<1));
     }
-    void execute(FloatType *a, FloatType *b) {
+    void execute(FloatType *a, FloatType *b) const {
         if(plan_ == nullptr) throw runtime_error("ZOMG");
-        fft::FFTTypes<FloatType>::r2rexec(plan_, a, b);
-    }
-    void store_wisdom() {
-        if(fft::FFTTypes<FloatType>::storefn(wisdom_fname().data()) == 0) {
-            std::fprintf(stderr, "Could not store wisdom at %s\n", wisdom_fname().data());
-        }
-    }
-    ~RFFTBlock() {
-        store_wisdom();
-        destroy();
+        fft::FFTTypes<FloatType>::r2rexec(plan_for(n_, a, b), a, b);
     }
 
     template<typename InVector, typename OutVector>
-    void apply(const InVector &in, OutVector &out) {
+    void apply(const InVector &in, OutVector &out) const {
         execute(in, out);
     }
 
     template<typename OutVector>
-    void apply(OutVector &out) {
-        execute(out);
+    void apply(OutVector &out) const {
+        if constexpr(blaze::IsMatrix<OutVector>::value) execute_batch(out);
+        else                                            execute(out);
+    }
+    template<typename MatrixType>
+    void apply_many(MatrixType &out) const {
+        execute_batch(out);
+    }
+    // Orthonormal DCT-II and DCT-III are each other's transposes.
+    template<typename OutVector>
+    void apply_transpose(OutVector &out) const {
+        if(!orthonormal_) throw std::runtime_error("apply_transpose requires an orthonormal DCT block.");
+        const fftw_r2r_kind kind(kind_ == FFTW_REDFT10 ? FFTW_REDFT01: FFTW_REDFT10);
+        if constexpr(blaze::IsMatrix<OutVector>::value) run_batch(out, kind);
+        else                                            run(out, kind);
     }
+    bool orthonormal() const {return orthonormal_;}
+    int size() const {return n_;}
 };
 
 template<typename FloatType>
 class FFTBlock {
     static_assert(is_floating_point<FloatType>::value, "FFTBlock must be floating point.");
     using ComplexType = std::complex<FloatType>;
+    using CType = typename fft::FFTTypes<FloatType>::ComplexType;
     using fftplan_t = typename fft::FFTTypes<FloatType>::PlanType;
+    using PlanCache = fft::PlanCache<FloatType>;
 
-    fftplan_t plan_;
+    fftplan_t plan_; // Cached plan for aligned arrays of size n_. Owned by PlanCache.
     int  direction_;
     int  n_, flags_;
     const bool oop_;
 
-public:
-
-    std::string wisdom_fname() const {
-        return std::string("dft.") + std::string(fft::FFTTypes<FloatType>::suffix());
-    }
-    void load_wisdom() {
-        if(std::ifstream(wisdom_fname().data()).good()) {
-            if(fft::FFTTypes<FloatType>::loadfn(wisdom_fname().data()) == 0) {
-                throw std::runtime_error(ks::sprintf("Could not load wisdom from %s\n", wisdom_fname()).data());
-            } else {
-                std::fprintf(stderr, "Loaded wisdom from %s\n", wisdom_fname().data());
-            }
-        }
-    }
-    // Real FFT block
-    void destroy() {
-        if(plan_) {
-            fft::FFTTypes<FloatType>::destroy_fn(plan_);
-        }
+    fftplan_t plan_for(int n, const ComplexType *in, const ComplexType *out) const {
+        auto cin(reinterpret_cast<const CType *>(in)), cout(reinterpret_cast<const CType *>(out));
+        if(n == n_ && (in != out) == oop_ && fft::FFTTypes<FloatType>::alignfn(reinterpret_cast<FloatType *>(const_cast<ComplexType *>(in))) == 0
+           && fft::FFTTypes<FloatType>::alignfn(reinterpret_cast<FloatType *>(const_cast<ComplexType *>(out))) == 0)
+            return plan_;
+        return PlanCache::instance().c2c(n, direction_, flags_, cin, cout);
     }
+
+public:
     void set_flags(int newflags) { flags_ = newflags;}
     void resize(int n) {
-        using CType = typename fft::FFTTypes<FloatType>::ComplexType;
         if(n == n_) return;
         n_ = n;
-        blaze::DynamicVector<ComplexType> tmpvec(n);
-        auto ptr1(&tmpvec[0]);
-        auto ptr2(oop_ ? ptr1: &blaze::DynamicVector<ComplexType>(n)[0]);
-        destroy();
-        plan_ = fft::FFTTypes<FloatType>::c2cplan1d(n_, (CType *)ptr1, (CType *)ptr2, direction_, flags_);
+        blaze::DynamicVector<ComplexType> tmpvec(n), tmpvec2(oop_ ? n: 0);
+        auto ptr1(reinterpret_cast<CType *>(&tmpvec[0]));
+        auto ptr2(oop_ ? reinterpret_cast<CType *>(&tmpvec2[0]): ptr1);
+        plan_ = PlanCache::instance().c2c(n_, direction_, flags_, ptr1, ptr2);
     }
     FFTBlock(int n, int direction=FFTW_FORWARD,
              bool oop=false, int flags=FFTW_PATIENT):
              plan_(nullptr), direction_(direction), n_(0), flags_(flags), oop_(oop)
     {
-        load_wisdom();
         resize(n);
     }
     template<typename VecType>
-    void execute(VecType &a) {
-        if(n_ != (int)a.size()) {
-            resize((int)a.size());
-        }
-        using CType = typename fft::FFTTypes<FloatType>::ComplexType;
-        fft::FFTTypes<FloatType>::c2cexec(plan_, (CType *)&a[0], (CType *)&a[0]);
+    void execute(VecType &a) const {
+        fft::FFTTypes<FloatType>::c2cexec(plan_for(a.size(), &a[0], &a[0]), (CType *)&a[0], (CType *)&a[0]);
         ComplexType tmp;
         tmp.real(std::sqrt(1./(a.size()<<1)));
         tmp.imag(0);
         a *= tmp;;
     }
     template<typename VecType1, typename VecType2>
-    void execute(const VecType1 &in, VecType2 &out) {
+    void execute(const VecType1 &in, VecType2 &out) const {
         if(out.size() < in.size()) throw "ZOMG";
-        if(n_ != in.size()) {
-            resize((int)in.size());
-        }
-        fft::FFTTypes<FloatType>::c2cexec(plan_, &in[0], &out[0]);
+        CType *const ip((CType *)&in[0]);
+        fft::FFTTypes<FloatType>::c2cexec(plan_for(in.size(), &in[0], &out[0]), ip, (CType *)&out[0]);
         out *= std::sqrt(1./(out.size()<<1));
     }
-    void execute(ComplexType *a, ComplexType *b) {
+    void execute(ComplexType *a, ComplexType *b) const {
         if(plan_ == nullptr) throw runtime_error("ZOMG");
-        using CType = typename fft::FFTTypes<FloatType>::ComplexType;
-        fft::FFTTypes<FloatType>::c2cexec(plan_, (CType *)a, (CType *)b);
+        fft::FFTTypes<FloatType>::c2cexec(plan_for(n_, a, b), (CType *)a, (CType *)b);
     }
-    void store_wisdom() {
-        if(fft::FFTTypes<FloatType>::storefn(wisdom_fname().data()) == 0) {
-            std::fprintf(stderr, "[W:] Could not store wisdom at %s\n", wisdom_fname().data());
-        }
-    }
-    ~FFTBlock() {
-        store_wisdom();
-        destroy();
+    // Transforms each row of a dense complex matrix, in either storage order, with one many-transform plan.
+    template<typename MatrixType>
+    void execute_batch(MatrixType &a) const {
+        const int n(a.columns()), howmany(a.rows());
+        if(n == 0 || howmany == 0) return;
+        const auto [stride, dist] = fft::batch_strides(a);
+        CType *const p(reinterpret_cast<CType *>(a.data()));
+        const auto plan(PlanCache::instance().c2c_many(n, direction_, flags_, p, howmany, stride, dist, fft::batch_threads(size_t(n) * howmany)));
+        fft::FFTTypes<FloatType>::c2cexec(plan, p, p);
+        a *= ComplexType(std::sqrt(1./(n<<1)), 0);
     }
 
     template<typename InVector, typename OutVector>
-    void apply(const InVector &in, OutVector &out) {
+    void apply(const InVector &in, OutVector &out) const {
         execute(in, out);
     }
 
     template<typename OutVector>
-    void apply(OutVector &out) {
-        execute(out);
+    void apply(OutVector &out) const {
+        if constexpr(blaze::IsMatrix<OutVector>::value) execute_batch(out);
+        else                                            execute(out);
+    }
+    template<typename MatrixType>
+    void apply_many(MatrixType &out) const {
+        execute_batch(out);
     }
 };
 
 
+/*
+ * Circulant matrix C with first column c, applied with real FFTs: C x = irfft(rfft(c) .* rfft(x)).
+ * The half spectrum of c, with FFTW's 1/n folded in, is computed once at construction,
+ * so an application is one r2c, one pointwise product and one c2r.
+ * The transpose is the circulant of c reversed, whose spectrum is the conjugate.
+ * Batches (dense matrices whose rows are vectors, in either storage order) use many-transform plans.
+ * Vectors must be contiguous. Any size works, but sizes with small prime factors are fastest (see fft::good_size).
+ */
 template<typename FloatType>
-class CirculantMatrix {
+class CirculantBlock {
+    static_assert(is_floating_point<FloatType>::value, "CirculantBlock must be floating point.");
     using ComplexType = std::complex<FloatType>;
-    blaze::DynamicVector<ComplexType> vec_;
-    blaze::DynamicVector<ComplexType> scratch_space_;
-    FFTBlock<FloatType> fwd_, bck_;
-public:
-    template<typename... Args>
-    CirculantMatrix(Args &&...args): fwd_(vec_.size(), FFTW_FORWARD), bck_(vec_.size(), FFTW_BACKWARD) {
-        blaze::DynamicVector<FloatType> tmp(std::forward<Args...>(args...));
-        vec_.resize(tmp.size());
-        for(size_t i(0); i < vec_.size(); ++i) {
-            vec_[i].real(tmp[i]);
+    using Types       = fft::FFTTypes<FloatType>;
+    using CType       = typename Types::ComplexType;
+    using fftplan_t   = typename Types::PlanType;
+    using PlanCache   = fft::PlanCache<FloatType>;
+
+    size_t n_;
+    int flags_;
+    blaze::DynamicVector<ComplexType> spectrum_;
+    fftplan_t fwd_, bck_; // Plans for aligned vectors. Owned by PlanCache.
+
+    size_t nfreq() const {return n_ / 2 + 1;}
+    static CType *cptr(ComplexType *ptr) {return reinterpret_cast<CType *>(ptr);}
+
+    template<typename VecType>
+    void init(const VecType &column) {
+        n_ = column.size();
+        if(n_ == 0) throw std::runtime_error("CirculantBlock needs a nonempty first column.");
+        blaze::DynamicVector<FloatType> tmp(n_);
+        for(size_t i(0); i < n_; ++i) tmp[i] = column[i];
+        spectrum_.resize(nfreq());
+        blaze::DynamicVector<ComplexType> freq(nfreq());
+        auto &cache(PlanCache::instance());
+        Types::r2cexec(cache.r2c(n_, flags_, &tmp[0], cptr(&spectrum_[0])), &tmp[0], cptr(&spectrum_[0]));
+        spectrum_ *= static_cast<FloatType>(1) / n_;
+        fwd_ = cache.r2c(n_, flags_, &tmp[0], cptr(&freq[0]));
+        bck_ = cache.c2r(n_, flags_, cptr(&freq[0]), &tmp[0]);
+    }
+    template<bool TRANSPOSE, typename VecType>
+    void circulate(VecType &out) const {
+        if(out.size() != n_) throw std::runtime_error(ks::sprintf("Wrong size for CirculantBlock: %zu, not %zu.", out.size(), n_).data());
+        if(n_ > 1 && &out[1] - &out[0] != 1) throw std::runtime_error("CirculantBlock requires contiguous vectors.");
+        // Spectra go to per-thread scratch, so threads can share one block.
+        thread_local blaze::DynamicVector<ComplexType> freq;
+        freq.resize(nfreq(), false);
+        FloatType *const x(&out[0]);
+        CType *const s(cptr(&freq[0]));
+        const bool aligned(Types::alignfn(x) == 0 && Types::alignfn(s) == 0);
+        Types::r2cexec(aligned ? fwd_: PlanCache::instance().r2c(n_, flags_, x, s), x, s);
+        if constexpr(TRANSPOSE) freq *= conj(spectrum_);
+        else                    freq *= spectrum_;
+        Types::c2rexec(aligned ? bck_: PlanCache::instance().c2r(n_, flags_, s, x), s, x);
+    }
+    template<bool TRANSPOSE, typename MatrixType>
+    void circulate_many(MatrixType &out) const {
+        static_assert(blaze::IsDenseMatrix<MatrixType>::value, "CirculantBlock batches must be dense matrices.");
+        if(out.columns() != n_) throw std::runtime_error(ks::sprintf("Wrong batch dimension for CirculantBlock: %zu, not %zu.", out.columns(), n_).data());
+        const int nvec(out.rows());
+        if(nvec == 0) return;
+        // Rows of a row-major batch are contiguous; an interleaved batch keeps element i of every vector in column i.
+        constexpr bool SOA(blaze::IsColumnMajorMatrix<MatrixType>::value);
+        const int rstride(SOA ? out.spacing(): 1), rdist(SOA ? 1: out.spacing());
+        thread_local blaze::DynamicMatrix<ComplexType> freq;
+        freq.resize(out.rows(), nfreq(), false);
+        const int cdist(freq.spacing());
+        FloatType *const x(out.data());
+        CType *const s(cptr(freq.data()));
+        auto &cache(PlanCache::instance());
+        Types::r2cexec(cache.r2c(n_, flags_, x, s, nvec, rstride, rdist, 1, cdist), x, s);
+        for(size_t i(0); i < out.rows(); ++i) {
+            auto r(row(freq, i));
+            if constexpr(TRANSPOSE) r *= trans(conj(spectrum_));
+            else                    r *= trans(spectrum_);
         }
-        fwd_.apply(vec_);
+        Types::c2rexec(cache.c2r(n_, flags_, s, x, nvec, 1, cdist, rstride, rdist), s, x);
+    }
+public:
+    // Circulant with an i.i.d. N(0, 1) first column.
+    CirculantBlock(size_t n, uint64_t seed=0, int flags=FFTW_PATIENT): n_(n), flags_(flags) {
+        blaze::DynamicVector<FloatType> column(n);
+        chunked_sample_fill<decltype(column), fast_unit_normal>(column, seed);
+        init(column);
+    }
+    template<typename VecType, typename=std::enable_if_t<blaze::IsVector<VecType>::value>>
+    explicit CirculantBlock(const VecType &column, int flags=FFTW_PATIENT): n_(0), flags_(flags) {
+        init(column);
     }
     template<typename InVector, typename OutVector>
-    void apply(const InVector &in, OutVector &out, blaze::DynamicVector<ComplexType> *scratch=nullptr) {
-        execute(in, out, scratch);
+    void apply(const InVector &in, OutVector &out) const {
+        out = in;
+        apply(out);
+    }
+    template<typename OutVector>
+    void apply(OutVector &out) const {circulate<false>(out);}
+    template<typename OutVector>
+    void apply_transpose(OutVector &out) const {circulate<true>(out);}
+    template<typename MatrixType>
+    void apply_many(MatrixType &out) const {circulate_many<false>(out);}
+    template<typename MatrixType>
+    void apply_many_transpose(MatrixType &out) const {circulate_many<true>(out);}
+    const auto &spectrum() const {return spectrum_;}
+    size_t size() const {return n_;}
+};
+
+template<typename FloatType>
+using CirculantMatrix = CirculantBlock<FloatType>;
+
+/*
+ * Partial Toeplitz projection T (m x n) with i.i.d. N(0, 1) diagonals: T(i, j) = t[i - j + n - 1].
+ * T is embedded in a circulant of FFT-friendly size L >= m + n - 1, so T x is the first m entries of C [x; 0]
+ * and T^T y is the first n entries of C^T [y; 0].
+ * Square blocks also apply in place, so they compose inside SpinBlockTransformer.
+ */
+template<typename FloatType>
+class ToeplitzBlock {
+    size_t m_, n_;
+    CirculantBlock<FloatType> circ_;
+
+    static blaze::DynamicVector<FloatType> embed(size_t m, size_t n, uint64_t seed) {
+        if(m == 0 || n == 0) throw std::runtime_error("ToeplitzBlock dimensions must be positive.");
+        blaze::DynamicVector<FloatType> t(m + n - 1), c(fft::good_size(m + n - 1), 0);
+        chunked_sample_fill<decltype(t), fast_unit_normal>(t, seed);
+        for(size_t i(0); i < m; ++i) c[i] = t[i + n - 1];             // First column.
+        for(size_t j(1); j < n; ++j) c[c.size() - j] = t[n - 1 - j]; // First row, wrapped around.
+        return c;
+    }
+    // Copies in to the front of a per-thread scratch vector, zero-pads, circulates and copies the first outsz entries out.
+    template<bool TRANSPOSE, typename InVector, typename OutVector>
+    void project(const InVector &in, OutVector &out, size_t insz, size_t outsz) const {
+        if(in.size() != insz || out.size() != outsz)
+            throw std::runtime_error(ks::sprintf("Wrong sizes for ToeplitzBlock: %zu -> %zu, not %zu -> %zu.", in.size(), out.size(), insz, outsz).data());
+        thread_local blaze::DynamicVector<FloatType> scratch;
+        scratch.resize(circ_.size(), false);
+        for(size_t i(0); i < insz; ++i) scratch[i] = in[i];
+        blaze::reset(subvector(scratch, insz, scratch.size() - insz));
+        if constexpr(TRANSPOSE) circ_.apply_transpose(scratch);
+        else                    circ_.apply(scratch);
+        for(size_t i(0); i < outsz; ++i) out[i] = scratch[i];
+    }
+    template<bool TRANSPOSE, typename MatrixType1, typename MatrixType2>
+    void project_many(const MatrixType1 &in, MatrixType2 &out, size_t insz, size_t outsz) const {
+        if(in.columns() != insz || out.columns() != outsz || in.rows() != out.rows())
+            throw std::runtime_error("Wrong batch shape for ToeplitzBlock.");
+        thread_local blaze::DynamicMatrix<FloatType> scratch;
+        scratch.resize(in.rows(), circ_.size(), false);
+        blaze::reset(scratch);
+        submatrix(scratch, 0, 0, in.rows(), insz) = in;
+        if constexpr(TRANSPOSE) circ_.apply_many_transpose(scratch);
+        else                    circ_.apply_many(scratch);
+        out = submatrix(scratch, 0, 0, in.rows(), outsz);
     }
+public:
+    ToeplitzBlock(size_t m, size_t n, uint64_t seed=0, int flags=FFTW_PATIENT):
+        m_(m), n_(n), circ_(embed(m, n, seed), flags) {}
 
+    // out (size m) = T in (size n).
+    template<typename InVector, typename OutVector>
+    void apply(const InVector &in, OutVector &out) const {project<false>(in, out, n_, m_);}
     template<typename OutVector>
-    void apply(OutVector &out, blaze::DynamicVector<ComplexType> *scratch=nullptr) {
-        blaze::DynamicVector<ComplexType> *sv(scratch ? *scratch: scratch_space_);
-        if(sv.size() != vec_.size()) sv.resize(vec_.size());
-        if(out.size() != vec_.size()) throw std::runtime_error("Wrong sizes in circulant application.");
-        vec::vecmul(&out[0], &vec_[0], out.size());
-        for(size_t i(0); i < out.size(); ++i) {
-            sv[i].real(out[i]);
-        }
-        fwd_.execute(sv[0]);
-        sv *= vec_;
-        bck_.execute(sv);
+    void apply(OutVector &out) const {
+        if(m_ != n_) throw std::runtime_error("In-place application needs a square ToeplitzBlock.");
+        project<false>(out, out, n_, m_);
+    }
+    // out (size n) = T^T in (size m).
+    template<typename InVector, typename OutVector>
+    void apply_transpose(const InVector &in, OutVector &out) const {project<true>(in, out, m_, n_);}
+    template<typename OutVector>
+    void apply_transpose(OutVector &out) const {
+        if(m_ != n_) throw std::runtime_error("In-place application needs a square ToeplitzBlock.");
+        project<true>(out, out, m_, n_);
+    }
+    // Batches: each row of in is an input vector.
+    template<typename MatrixType1, typename MatrixType2>
+    void apply_many(const MatrixType1 &in, MatrixType2 &out) const {project_many<false>(in, out, n_, m_);}
+    template<typename MatrixType>
+    void apply_many(MatrixType &out) const {
+        if(m_ != n_) throw std::runtime_error("In-place application needs a square ToeplitzBlock.");
+        project_many<false>(out, out, n_, m_);
     }
+    size_t rows()    const {return m_;}
+    size_t columns() const {return n_;}
+    size_t size()    const {return n_;}
 };
 
 template<typename FloatType>
 class DCTBlock: public RFFTBlock<FloatType> {
 public:
-    DCTBlock(int n, bool oop=false, int flags=FFTW_PATIENT): RFFTBlock<FloatType>(n, FFTW_REDFT10, oop, flags) {}
+    DCTBlock(int n, bool oop=false, int flags=FFTW_PATIENT, bool orthonormal=false): RFFTBlock<FloatType>(n, FFTW_REDFT10, oop, flags, orthonormal) {}
 };
 template<typename FloatType>
 class IDCTBlock: public RFFTBlock<FloatType> {
 public:
-    IDCTBlock(int n, bool oop=false, int flags=FFTW_PATIENT): RFFTBlock<FloatType>(n, FFTW_REDFT01, oop, flags) {}
+    IDCTBlock(int n, bool oop=false, int flags=FFTW_PATIENT, bool orthonormal=false): RFFTBlock<FloatType>(n, FFTW_REDFT01, oop, flags, orthonormal) {}
 };
 
 } // namespace frp
@@ -1,5 +1,7 @@
 #ifndef _GFRP_TX_H__
 #define _GFRP_TX_H__
+#include <iterator>
+#include <numeric>
 #include "blaze/Math.h"
 #include "frp/rand.h"
 
@@ -7,15 +9,148 @@
 
 namespace frp {
 
+// Above this size, fill_shuffled shuffles cache-sized blocks in parallel and merges them.
+static constexpr size_t PARALLEL_SHUFFLE_THRESHOLD = size_t(1) << 22;
+static constexpr size_t SHUFFLE_BLOCK              = size_t(1) << 18;
+
+namespace detail {
+
+/*
+ * Batched bounded draws (Brackett-Rozinsky & Lemire, "Batched Ranged Random Integer Generation", 2024):
+ * out[j] is uniform in [0, i - j) for j < K, all from one 64-bit word when i (i - 1) ... (i - K + 1) < 2^64.
+ * Each multiply by a bound peels one index off the high word and leaves the low word for the next;
+ * the final low word decides rejection exactly as in random_bounded_nearlydivisionless64.
+ */
+template<size_t K, typename RNG>
+inline void random_bounded_batch(uint64_t i, uint64_t (&out)[K], RNG &gen) {
+    static_assert(sizeof(typename RNG::result_type) == sizeof(uint64_t), "Batched draws need 64-bit random words.");
+    uint64_t product(1);
+    for(size_t j = 0; j < K; ++j) product *= i - j;
+    for(uint64_t threshold(0);;) {
+        uint64_t leftover(gen());
+        for(size_t j = 0; j < K; ++j) {
+            const __uint128_t m(static_cast<__uint128_t>(leftover) * (i - j));
+            out[j] = static_cast<uint64_t>(m >> 64);
+            leftover = static_cast<uint64_t>(m);
+        }
+        if(leftover >= product) return;
+        if(threshold == 0) threshold = -product % product;
+        if(leftover >= threshold) return;
+    }
+}
+
+// Fisher-Yates on [first, first + n), taking as many indices per random word as the remaining size allows.
+template<typename It, typename RNG>
+void batched_shuffle(It first, uint64_t n, RNG &gen) {
+    using std::swap;
+    uint64_t i(n);
+    for(; i > (uint64_t(1) << 30); --i)
+        swap(first[i - 1], first[rng::random_bounded_nearlydivisionless64(i, gen)]);
+    auto run = [&](auto k, uint64_t floor) {
+        constexpr size_t K = decltype(k)::value;
+        uint64_t idx[K];
+        for(; i > floor; i -= K) {
+            random_bounded_batch<K>(i, idx, gen);
+            for(size_t j = 0; j < K; ++j) swap(first[i - 1 - j], first[idx[j]]);
+        }
+    };
+    run(std::integral_constant<size_t, 2>(), uint64_t(1) << 19);
+    run(std::integral_constant<size_t, 3>(), uint64_t(1) << 14);
+    run(std::integral_constant<size_t, 4>(), uint64_t(1) << 11);
+    run(std::integral_constant<size_t, 5>(), uint64_t(1) << 9);
+    run(std::integral_constant<size_t, 6>(), 6);
+    for(; i > 1; --i)
+        swap(first[i - 1], first[rng::random_bounded_nearlydivisionless64(i, gen)]);
+}
+
+// pick_b ? b: a, without a branch.
+template<typename T>
+inline T select(bool pick_b, T a, T b) {
+    if constexpr(std::is_integral<T>::value) {
+        return a ^ ((a ^ b) & -static_cast<T>(pick_b));
+    } else {
+        const T ab[2] {a, b};
+        return ab[pick_b];
+    }
+}
+
+// MergeShuffle merge (Bacher, Bodini, Hollender & Lumbroso, 2015): given uniformly shuffled
+// [first, mid) and [mid, last), leaves [first, last) uniformly shuffled. Coin flips interleave the halves
+// until one runs out; the rest is placed by Fisher-Yates insertion.
+// While both halves are nonempty the step is branch-free, since the coin flips are unpredictable by design.
+template<typename It, typename RNG>
+void merge_shuffled(It first, It mid, It last, RNG &gen) {
+    using std::swap;
+    It u(first), v(mid);
+    uint64_t bits(0);
+    unsigned nbits(0);
+    if(v != last) {
+        // y caches *v, so no iteration reloads what the previous one stored.
+        for(auto y(*v); u != v && v + 1 != last; ++u) {
+            if(nbits == 0) bits = gen(), nbits = 64;
+            const bool flip(bits & 1);
+            bits >>= 1, --nbits;
+            const auto x(*u);
+            *u = select(flip, x, y);
+            *v = select(flip, y, x);
+            y = select(flip, y, v[1]);
+            v += flip;
+        }
+    }
+    for(;; ++u) {
+        if(nbits == 0) bits = gen(), nbits = 64;
+        const bool flip(bits & 1);
+        bits >>= 1, --nbits;
+        if(flip) {
+            if(v == last) break;
+            swap(*u, *v++);
+        } else if(u == v) break;
+    }
+    for(; u < last; ++u)
+        swap(*u, first[rng::random_bounded_nearlydivisionless64(u - first + 1, gen)]);
+}
+
+/*
+ * Parallel shuffle: 2^k blocks of about SHUFFLE_BLOCK elements are shuffled independently, then merged pairwise.
+ * Node v of the merge tree (root 1, children 2v and 2v + 1, leaves nblocks ... 2 nblocks - 1)
+ * draws from AesCtr stream v, so the permutation depends only on the seed and n, not on the thread count.
+ */
+template<typename It>
+void parallel_shuffle(It first, uint64_t n, uint64_t seed) {
+    size_t nblocks(1);
+    while(n / nblocks > SHUFFLE_BLOCK) nblocks <<= 1;
+    auto bound = [&](size_t b) {return static_cast<int64_t>(n * b / nblocks);};
+    #pragma omp parallel for schedule(dynamic)
+    for(size_t b = 0; b < nblocks; ++b) {
+        aes::AesCtr<uint64_t> gen(seed, nblocks + b);
+        batched_shuffle(first + bound(b), bound(b + 1) - bound(b), gen);
+    }
+    for(size_t width(2); width <= nblocks; width <<= 1) {
+        const size_t nmerges(nblocks / width);
+        #pragma omp parallel for schedule(dynamic) if(nmerges > 1)
+        for(size_t p = 0; p < nmerges; ++p) {
+            aes::AesCtr<uint64_t> gen(seed, nmerges + p);
+            merge_shuffled(first + bound(p * width), first + bound(p * width + width / 2), first + bound((p + 1) * width), gen);
+        }
+    }
+}
+
+} // namespace detail
+
+// Fills con with a uniformly random permutation of 0, ..., size - 1, determined by seed and size.
 template<class Container>
 void fill_shuffled(uint64_t seed, Container &con) {
-    // Note: this does not permit the setting of a seed. This should probably be changed.
     std::iota(std::begin(con), std::end(con), static_cast<std::decay_t<decltype(con[0])>>(0));
 #if USE_STD
     std::random_shuffle(std::begin(con), std::end(con));
 #else
-    aes::AesCtr<uint64_t> gen(seed);
-    for(size_t i(con.size()); i > 1; std::swap(con[rng::random_bounded_nearlydivisionless64(i-1, gen)], con[i-1]), --i);
+    const uint64_t n(std::size(con));
+    if(n > PARALLEL_SHUFFLE_THRESHOLD) {
+        detail::parallel_shuffle(std::begin(con), n, seed);
+    } else {
+        aes::AesCtr<uint64_t> gen(seed);
+        detail::batched_shuffle(std::begin(con), n, gen);
+    }
 #endif
 }
 
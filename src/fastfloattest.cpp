@@ -0,0 +1,101 @@
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+#include "frp/fastfloat.h"
+
+// Checks fastfloat::parse against strtod/strtof (value bits and end of number) on fixed edge cases
+// and random inputs, then compares its throughput with atof. Exits nonzero on any mismatch.
+// Usage: fastfloattest [rounds of random inputs, default 3000000]
+
+using namespace frp;
+
+static size_t nbad;
+
+template<typename T>
+bool same(T a, T b) {return std::memcmp(&a, &b, sizeof(T)) == 0 || (std::isnan(a) && std::isnan(b));}
+
+template<typename T>
+void check(const std::string &s) {
+    T got;
+    const char *const end(fastfloat::parse(s.data(), s.data() + s.size(), got));
+    char *ref_end;
+    const T want(sizeof(T) == 8 ? static_cast<T>(std::strtod(s.data(), &ref_end)): static_cast<T>(std::strtof(s.data(), &ref_end)));
+    if(!same(got, want) || end != ref_end) {
+        if(nbad++ < 20)
+            std::fprintf(stderr, "%s '%s': got %.17g, want %.17g; end %td, want %td\n", sizeof(T) == 8 ? "double": "float",
+                         s.data(), double(got), double(want), end - s.data(), ref_end - s.data());
+    }
+}
+
+int main(int argc, char *argv[]) {
+    const size_t nrounds(argc > 1 ? std::strtoull(argv[1], nullptr, 10): 3000000);
+    const std::vector<std::string> fixed {
+        "0", "-0", "1", "1.5", ".5", "5.", "1e", "1e+", "1e-5", "+3.25", "  7", "\t-2.5e3", "inf", "-inf", "nan", "abc", "", "-", ".", "1,2",
+        "1.7976931348623157e308", "1.7976931348623159e308", "4.9406564584124654e-324", "2.4703282292062327e-324", "2.4703282292062328e-324",
+        "2.2250738585072011e-308", "9007199254740993", "9007199254740992.5", "0.000000000000000000000000000123456789012345678901234567890",
+        "123456789012345678901234567890", "1e-400", "-1e-400", "1e400", "1234567890123456789012345e300", "-1234567890123456789012345e-400",
+        "00000000000000000000000000001.5", "3.4028235e38", "3.4028236e38", "1.17549435e-38", "1.4e-45", "7.0e-46", "0.1", "0.2", "0.3",
+        "1e22", "1e23", "8.589973e9", "1.00000005960464477539062499", "1.00000005960464477539062500", "1.000000059604644775390625000001",
+        "9.999999999999999999", "18446744073709551615", "18446744073709551616",
+        "0x1p3", "-0x1.8p1", "0X.8", "0x1P-1074", "0x1p-1080", "0x1p1100", "-0x1p1100", "0xAbC.dEf", "0x", "0x.", "0xg", "0x-1", "0x1p", "0x1.p+2",
+        "+-1", "-+1", "++1", "--1", "+-inf", "+-0x1p3"
+    };
+    for(const auto &s: fixed) check<double>(s), check<float>(s);
+    std::mt19937_64 gen(1);
+    char buf[128];
+    for(size_t i(0); i < nrounds; ++i) {
+        const uint64_t bits(gen());
+        double d;
+        std::memcpy(&d, &bits, sizeof(d));
+        if(!std::isfinite(d)) continue;
+        std::snprintf(buf, sizeof(buf), gen() & 1 ? "%.*g": "%.*e", 1 + int(gen() % 18), d);
+        check<double>(buf);
+        std::snprintf(buf, sizeof(buf), "%.25g", d); // Long, often near halfway between doubles.
+        check<double>(buf);
+        std::snprintf(buf, sizeof(buf), "%.12f", d * 1e-300);
+        check<double>(buf);
+        std::snprintf(buf, sizeof(buf), "%a", d);
+        check<double>(buf);
+        float f;
+        const uint32_t fbits(bits >> 32);
+        std::memcpy(&f, &fbits, sizeof(f));
+        if(std::isfinite(f)) {
+            std::snprintf(buf, sizeof(buf), "%.*g", 1 + int(gen() % 10), f);
+            check<float>(buf);
+        }
+        // Random digit strings, with and without a point and exponent.
+        std::string s;
+        for(size_t k(0), nd(1 + gen() % 25); k < nd; ++k) s += char('0' + gen() % 10);
+        if(gen() & 1) s.insert(gen() % s.size(), ".");
+        if(gen() & 1) s += "e" + std::to_string(int(gen() % 700) - 350);
+        check<double>(s), check<float>(s);
+    }
+    std::fprintf(stderr, "%zu mismatches\n", nbad);
+
+    std::string text;
+    std::uniform_real_distribution<double> dist(-100, 100);
+    for(size_t i(0); i < 2000000; ++i) {
+        std::snprintf(buf, sizeof(buf), "%.6f,", dist(gen));
+        text += buf;
+    }
+    double sum(0), refsum(0);
+    auto t0(std::chrono::steady_clock::now());
+    for(const char *p(text.data()), *e(p + text.size()); p < e; ++p) {
+        double v;
+        p = fastfloat::parse(p, e, v);
+        sum += v;
+    }
+    auto t1(std::chrono::steady_clock::now());
+    for(const char *p(text.data()); *p; p = std::strchr(p, ',') + 1) refsum += std::atof(p);
+    auto t2(std::chrono::steady_clock::now());
+    std::fprintf(stderr, "fastfloat::parse: %0.1lf MB/s; atof: %0.1lf MB/s\n",
+                 text.size() * 1e-6 / std::chrono::duration<double>(t1 - t0).count(),
+                 text.size() * 1e-6 / std::chrono::duration<double>(t2 - t1).count());
+    if(sum != refsum) std::fprintf(stderr, "Sums differ: %0.17g vs %0.17g\n", sum, refsum), ++nbad;
+    return nbad ? EXIT_FAILURE: EXIT_SUCCESS;
+}
@@ -47,28 +47,23 @@ int main(int argc, char *argv[]) {
     const int fn(fileno(ofp));
     OJLTransform jl(nd, target_dim, seed, nblocks);
     ks::string str(vecbufsz);
-#if PARALLEL_PARSE
-    std::vector<unsigned> tmp;
-#endif
     blaze::DynamicVector<FLOAT_TYPE> vec(roundup(vecsize));
-#if USE_OPENMP
-    omp_set_num_threads(8);
-#endif
-    for(auto &line: ic) {
-#if PARALLEL_PARSE
-        line.set(vec, tmp);
-#else
-        line.set(vec);
-#endif
-        jl.transform_inplace(vec);
-        ksprint(subvector(vec, 0, target_dim), str);
-        str.putc_('\n');
-        if(str.size() & (~((str.capacity()>>1) - 1))) {
-            // if str.size >= str.capacity/2
-            str.write(fn);
-            str.clear();
+    blaze::DynamicMatrix<FLOAT_TYPE> batch;
+    // Batches of rows are parsed in parallel; rows are then transformed and written in input order.
+    ic.for_each_dense_batch(batch, [&](const auto &rows) {
+        for(size_t i(0); i < rows.rows(); ++i) {
+            subvector(vec, 0, vecsize) = trans(row(rows, i));
+            blaze::reset(subvector(vec, vecsize, vec.size() - vecsize));
+            jl.transform_inplace(vec);
+            ksprint(subvector(vec, 0, target_dim), str);
+            str.putc_('\n');
+            if(str.size() & (~((str.capacity()>>1) - 1))) {
+                // if str.size >= str.capacity/2
+                str.write(fn);
+                str.clear();
+            }
         }
-    }
+    }, ',', vecsize);
     str.write(fn);
     str.clear();
     if(ofp != stdout) fclose(ofp);
@@ -0,0 +1,73 @@
+#include "frp/frp.h"
+#include <cstdio>
+
+// Checks that batched apply_many matches applying the same block to each vector in turn.
+using namespace frp;
+
+template<typename FloatType>
+using Batch = blaze::DynamicMatrix<FloatType, blaze::columnMajor>; // Interleaved: rows are vectors.
+
+template<typename MatrixType>
+void fill_batch(MatrixType &mat, uint64_t seed) {
+    aes::AesCtr<uint64_t> gen(seed);
+    for(size_t i(0); i < mat.rows(); ++i)
+        for(size_t j(0); j < mat.columns(); ++j)
+            mat(i, j) = static_cast<double>(gen() >> 11) / (UINT64_C(1) << 53) - .5;
+}
+
+template<typename MatrixType>
+bool report(const char *name, size_t n, const MatrixType &batched, const MatrixType &single) {
+    const double err(blaze::max(blaze::abs(batched - single)));
+    std::fprintf(stderr, "%s\tn=%zu\tmax error %g\t%s\n", name, n, err, err < 1e-5 ? "ok": "FAIL");
+    return err < 1e-5;
+}
+
+bool check_rademacher(size_t n, size_t nvecs) {
+    PRNRademacher rad(n, 13);
+    Batch<double> batched(nvecs, n), single;
+    fill_batch(batched, n);
+    single = batched;
+    rad.apply_many(batched);
+    for(size_t i(0); i < nvecs; ++i) {
+        blaze::DynamicVector<double> vec(trans(row(single, i)));
+        rad.apply(vec);
+        row(single, i) = trans(vec);
+    }
+    return report("PRNRademacher", n, batched, single);
+}
+
+bool check_spinner(const char *spec, size_t n, size_t nvecs) {
+    DynamicSpinTransformer<double> tx(spec, n, 13);
+    Batch<double> batched(nvecs, n), single;
+    fill_batch(batched, n);
+    single = batched;
+    tx.apply_many(batched);
+    for(size_t i(0); i < nvecs; ++i) {
+        blaze::DynamicVector<double> vec(trans(row(single, i)));
+        tx.apply(vec);
+        row(single, i) = trans(vec);
+    }
+    return report(spec, n, batched, single);
+}
+
+bool check_sorf(size_t n, size_t nvecs) {
+    sorf::KernelBlock<double> kb(n, 13);
+    Batch<double> in(nvecs, n), batched(nvecs, n), single(nvecs, n);
+    fill_batch(in, n);
+    kb.apply_many(batched, in);
+    for(size_t i(0); i < nvecs; ++i) {
+        blaze::DynamicVector<double> vec(n), invec(trans(row(in, i)));
+        kb.apply(vec, invec);
+        row(single, i) = trans(vec);
+    }
+    return report("sorf::KernelBlock", n, batched, single);
+}
+
+int main() {
+    bool ok(true);
+    for(const size_t n: {1, 7, 63, 64, 100, 256, 1000}) ok &= check_rademacher(n, 5);
+    for(const size_t n: {16, 32, 100}) ok &= check_spinner("R,G", n, 5);
+    for(const size_t n: {16, 32, 128}) ok &= check_spinner("S,H,R,P,H,R", n, 5);
+    for(const size_t n: {16, 32, 256}) ok &= check_sorf(n, 5);
+    return ok ? EXIT_SUCCESS: EXIT_FAILURE;
+}
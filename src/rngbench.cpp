@@ -0,0 +1,136 @@
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+#include <getopt.h>
+#include "frp/frp.h"
+
+// Throughput of random number generators and dist.h fills.
+// Prints one tab-separated line per (generator or fill, mode): GB/s of output and millions of samples/s.
+
+using namespace frp;
+using clk = std::chrono::steady_clock;
+
+static uint64_t sink; // Keeps results live.
+
+int usage(char *arg) {
+    std::fprintf(stderr, "Usage: %s <opts>\n"
+                         "-n\tElements per round [1 << 20]\n"
+                         "-r\tRounds [20]\n"
+                         "-g\tSkip generators\n"
+                         "-d\tSkip distribution fills\n", arg);
+    return EXIT_FAILURE;
+}
+
+struct Result {
+    double seconds;
+    size_t nsamples, nbytes;
+};
+
+void report(const std::string &name, const char *mode, const Result &r) {
+    std::fprintf(stdout, "%s\t%s\t%0.3lf\t%0.2lf\n", name.data(), mode, r.nbytes / r.seconds * 1e-9, r.nsamples / r.seconds * 1e-6);
+    std::fflush(stdout);
+}
+
+template<typename Func>
+double time_rounds(size_t nrounds, const Func &func) {
+    func(); // Warm up: page in buffers, run first-use initialization.
+    const auto start(clk::now());
+    for(size_t i(0); i < nrounds; ++i) func();
+    return std::chrono::duration<double>(clk::now() - start).count();
+}
+
+template<typename RNG>
+void bench_generator(const std::string &name, size_t n, size_t nrounds) {
+    using T = typename RNG::result_type;
+    std::vector<T> vec(n);
+    RNG rng(13);
+    const size_t total(n * nrounds);
+    double t = time_rounds(nrounds, [&]() {
+        for(size_t j(0); j < vec.size(); ++j) vec[j] = rng();
+        sink += vec[n / 2];
+    });
+    report(name, "sequential", Result{t, total, total * sizeof(T)});
+    if constexpr(rng::is_counter_based<RNG>::value) {
+        // Scattered indices, so consecutive calls never share a block.
+        static constexpr uint64_t STRIDE = 0x9E3779B97F4A7C15ull;
+        t = time_rounds(nrounds, [&]() {
+            for(size_t j(0); j < vec.size(); ++j) vec[j] = rng[j * STRIDE];
+            sink += vec[n / 2];
+        });
+        report(name, "random_access", Result{t, total, total * sizeof(T)});
+        t = time_rounds(nrounds, [&]() {
+            rng.fill(vec.data(), vec.size() * sizeof(T));
+            sink += vec[n / 2];
+        });
+        report(name, "bulk_fill", Result{t, total, total * sizeof(T)});
+        t = time_rounds(nrounds, [&]() {
+            rng.generate_range(n * 3, vec.size(), vec.data());
+            sink += vec[n / 2];
+        });
+        report(name, "generate_range", Result{t, total, total * sizeof(T)});
+    }
+}
+
+template<typename Filler>
+void bench_fill(const char *name, const char *mode, size_t n, size_t nrounds, const Filler &fill) {
+    blaze::DynamicVector<FLOAT_TYPE> vec(n);
+    uint64_t seed(0);
+    const double t = time_rounds(nrounds, [&]() {
+        fill(vec, seed++);
+        sink += static_cast<uint64_t>(vec[n / 2] * 1e6);
+    });
+    report(name, mode, Result{t, n * nrounds, n * nrounds * sizeof(FLOAT_TYPE)});
+}
+
+#define BENCH_FILL(name) \
+    bench_fill(#name, "serial",   n, nrounds, [](auto &v, uint64_t s) {name##_fill(v, s);}); \
+    bench_fill(#name, "parallel", n, nrounds, [](auto &v, uint64_t s) {name##_fill_parallel(v, s);})
+#define BENCH_FAST_FILL(name) \
+    bench_fill(#name, "fast",     n, nrounds, [](auto &v, uint64_t s) {fast_##name##_fill(v, s);})
+
+int main(int argc, char *argv[]) {
+    size_t n(1 << 20), nrounds(20);
+    bool generators(true), dists(true);
+    for(int c; (c = getopt(argc, argv, "n:r:gdh?")) >= 0;) {
+        switch(c) {
+            case 'n': n = std::strtoull(optarg, nullptr, 10); break;
+            case 'r': nrounds = std::strtoull(optarg, nullptr, 10); break;
+            case 'g': generators = false; break;
+            case 'd': dists = false; break;
+            case 'h': case '?': return usage(*argv);
+        }
+    }
+    if(n == 0 || nrounds == 0) return usage(*argv);
+    std::fprintf(stdout, "#name\tmode\tGB/s\tMsamples/s\n");
+    if(generators) {
+        bench_generator<aes::AesCtr<uint64_t, 2>>("AesCtr<uint64_t, 2>", n, nrounds);
+        bench_generator<aes::AesCtr<uint64_t, 4>>("AesCtr<uint64_t, 4>", n, nrounds);
+        bench_generator<aes::AesCtr<uint64_t, 8>>("AesCtr<uint64_t, 8>", n, nrounds);
+        bench_generator<aes::AesCtr<uint64_t, 16>>("AesCtr<uint64_t, 16>", n, nrounds);
+        bench_generator<aes::AesCtr<uint32_t, 8>>("AesCtr<uint32_t, 8>", n, nrounds);
+        bench_generator<rng::Philox4x32<uint64_t>>("Philox4x32<uint64_t>", n, nrounds);
+        bench_generator<rng::Philox4x32<uint32_t>>("Philox4x32<uint32_t>", n, nrounds);
+        bench_generator<rng::WyRand<uint64_t>>("WyRand<uint64_t>", n, nrounds);
+        bench_generator<std::mt19937_64>("mt19937_64", n, nrounds);
+        bench_generator<std::mt19937>("mt19937", n, nrounds);
+    }
+    if(dists) {
+        BENCH_FILL(gaussian);
+        BENCH_FILL(unit_gaussian);
+        BENCH_FILL(cauchy);
+        BENCH_FILL(chisq);
+        BENCH_FILL(lognormal);
+        BENCH_FILL(extreme_value);
+        BENCH_FILL(weibull);
+        BENCH_FILL(uniform);
+        BENCH_FAST_FILL(gaussian);
+        BENCH_FAST_FILL(unit_gaussian);
+        BENCH_FAST_FILL(chisq);
+        BENCH_FAST_FILL(gamma);
+        BENCH_FAST_FILL(uniform);
+    }
+    std::fprintf(stderr, "checksum: %zu\n", size_t(sink));
+}
@@ -0,0 +1,123 @@
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include "frp/parser.h"
+
+// Round-trips text through each compressed format, with the edge cases that have broken io::open_stream before:
+// zero padding and junk after the last gzip member, concatenated members, zstd frames with and without checksums,
+// and truncated inputs, which must throw. Every file is read with several read sizes, threaded and not.
+// Exits nonzero on any failure.
+
+using namespace frp;
+
+static size_t nbad;
+
+static std::string make_text() {
+    std::string ret;
+    for(unsigned i(0); i < 200000; ++i) ret += std::to_string(i * 2654435761u) + '\n';
+    return ret;
+}
+
+static void write_file(const std::string &path, const std::string &data) {
+    FILE *fp(std::fopen(path.data(), "wb"));
+    if(fp == nullptr || std::fwrite(data.data(), 1, data.size(), fp) != data.size())
+        throw std::runtime_error("Could not write " + path);
+    std::fclose(fp);
+}
+
+static std::string gzip(const std::string &text) {
+    z_stream zs{};
+    if(deflateInit2(&zs, 6, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) throw std::runtime_error("deflateInit2 failed");
+    std::string ret(deflateBound(&zs, text.size()), '\0');
+    zs.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(text.data()));
+    zs.avail_in = text.size();
+    zs.next_out = reinterpret_cast<Bytef *>(&ret[0]);
+    zs.avail_out = ret.size();
+    if(deflate(&zs, Z_FINISH) != Z_STREAM_END) throw std::runtime_error("deflate failed");
+    ret.resize(zs.total_out);
+    deflateEnd(&zs);
+    return ret;
+}
+
+#ifdef FRP_HAVE_ZSTD
+static std::string zstd(const std::string &text, bool checksum) {
+    ZSTD_CCtx *cctx(ZSTD_createCCtx());
+    ZSTD_CCtx_setParameter(cctx, ZSTD_c_checksumFlag, checksum);
+    std::string ret(ZSTD_compressBound(text.size()), '\0');
+    const size_t n(ZSTD_compress2(cctx, &ret[0], ret.size(), text.data(), text.size()));
+    ZSTD_freeCCtx(cctx);
+    if(ZSTD_isError(n)) throw std::runtime_error(ZSTD_getErrorName(n));
+    ret.resize(n);
+    return ret;
+}
+#endif
+
+#ifdef FRP_HAVE_BZIP2
+static std::string bzip2(const std::string &text) {
+    std::string ret(text.size() + text.size() / 100 + 600, '\0');
+    unsigned len(ret.size());
+    if(BZ2_bzBuffToBuffCompress(&ret[0], &len, const_cast<char *>(text.data()), text.size(), 9, 0, 0) != BZ_OK)
+        throw std::runtime_error("bzip2 compression failed");
+    ret.resize(len);
+    return ret;
+}
+#endif
+
+// Reads path fully with each read size; expects want, or an exception if want is null.
+static void check(const std::string &path, const std::string *want) {
+    for(const bool threaded: {false, true}) {
+        for(const size_t len: {size_t(1), size_t(7), size_t(4096), size_t(1) << 20}) {
+            std::string got;
+            bool threw(false);
+            try {
+                auto in(io::open_stream(path, io::UNKNOWN, threaded));
+                std::vector<char> buf(len);
+                for(size_t n; (n = in->read(buf.data(), len)) != 0;) got.append(buf.data(), n);
+            } catch(const std::exception &) {
+                threw = true;
+            }
+            const bool ok(want ? !threw && got == *want: threw);
+            if(!ok) {
+                ++nbad;
+                std::fprintf(stderr, "FAIL %s (read size %zu, %s): %s\n", path.data(), len, threaded ? "threaded": "unthreaded",
+                             want ? threw ? "threw": "wrong output": "did not throw");
+            }
+        }
+    }
+}
+
+int main(int argc, char *argv[]) {
+    const std::string dir(argc > 1 ? argv[1]: "/tmp"), prefix(dir + "/frp_streamtest");
+    const std::string text(make_text()), twice(text + text);
+    const std::string gz(gzip(text));
+    std::vector<std::string> paths;
+    auto add = [&](const std::string &suffix, const std::string &data, const std::string *want) {
+        paths.push_back(prefix + suffix);
+        write_file(paths.back(), data);
+        check(paths.back(), want);
+    };
+    add(".gz",          gz,                                   &text);
+    add(".padded.gz",   gz + std::string(10240, '\0'),        &text);
+    add(".concat.gz",   gz + gz,                              &twice);
+    add(".junk.gz",     gz + gz + "junk",                     &twice);
+    add(".magic1.gz",   gz + '\x1f',                          &text);
+    add(".trunc.gz",    gz.substr(0, gz.size() / 2),          nullptr);
+#ifdef FRP_HAVE_ZSTD
+    const std::string zst(zstd(text, false)), zstck(zstd(text, true));
+    add(".zst",         zst,                                  &text);
+    add(".check.zst",   zstck,                                &text);
+    add(".concat.zst",  zst + zstck,                          &twice);
+    add(".trunc.zst",   zst.substr(0, zst.size() / 2),        nullptr);
+    add(".trunc1.zst",  zst.substr(0, zst.size() - 1),        nullptr);
+#endif
+#ifdef FRP_HAVE_BZIP2
+    const std::string bz(bzip2(text));
+    add(".bz2",         bz,                                   &text);
+    add(".concat.bz2",  bz + bz,                              &twice);
+    add(".trunc.bz2",   bz.substr(0, bz.size() / 2),          nullptr);
+#endif
+    for(const auto &path: paths) std::remove(path.data());
+    std::fprintf(stderr, "%zu files, %zu failures\n", paths.size(), nbad);
+    return nbad ? EXIT_FAILURE: EXIT_SUCCESS;
+}